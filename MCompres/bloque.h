@@ -0,0 +1,601 @@
+#ifndef BLOQUE_H
+#define BLOQUE_H
+
+#include <stdint.h>
+#include <string.h>
+#include <exception>
+#include <memory>
+#include <span>
+#include <vector>
+#include "fichero.h"
+#include "huffman.h"
+#include "../common/dictionary.hpp"
+#include "../lzw/lzw.hpp"
+
+/* Cada bloque empieza por un byte con su modo. Los dos modos Huffman usan
+   como modo el número de flujos, igual que en la versión 3 del formato */
+#define MODO_CRUDO 0        /* Los bytes originales, tal cual */
+#define MODO_HUFFMAN 1      /* Huffman con un flujo de bits */
+#define MODO_RACHAS 2       /* Rachas de bytes repetidos y tramos literales */
+#define MODO_LZW 3          /* Anchura máxima y códigos LZW de anchura variable */
+#define MODO_HUFFMAN4 4     /* Huffman con cuatro flujos entrelazados */
+#define MODO_CONTEXTO 5     /* Huffman de orden 1, con una tabla por grupo de contextos */
+#define MODO_ESTATICO 6     /* Huffman con el código de un diccionario entrenado, sin tabla */
+#define MODO_LZW_CEBADO 7   /* LZW que parte del diccionario cebado con la muestra de un diccionario entrenado */
+
+/* Los bloques MODO_ESTATICO y MODO_LZW_CEBADO llevan tras el modo el
+   identificador del diccionario con el que se escribieron. Si no se tiene
+   ese diccionario, la descompresión devuelve ERROR_DICCIONARIO en vez de -1 */
+#define ERROR_DICCIONARIO -2
+
+/* Rachas: un byte de control t seguido de sus datos.
+     t < 128    t + 1 bytes literales
+     t >= 128   un byte que se repite (t - 128) + MIN_RACHA veces; si
+                t - 128 es 127, la longitud sigue en bytes de 7 bits, de
+                menor a mayor peso, con el bit alto a 1 salvo en el último */
+#define MIN_RACHA 3
+#define MAX_LITERALES 128
+
+/* Bytes del principio del bloque que se prueban con LZW antes de decidir */
+#define TAM_MUESTRA_LZW (64 * 1024)
+
+/* Un modo sólo se usa si ahorra al menos 1/AHORRO_MINIMO del bloque; si no,
+   no compensa lo que cuesta descomprimirlo y se guarda el bloque tal cual */
+#define AHORRO_MINIMO 64
+
+/* Memoria de trabajo de un hilo que comprime bloques: la del cálculo de
+   las longitudes, la cuenta de pares de los bloques de orden 1 (256 KB,
+   que no conviene pedir y borrar de nuevo en cada bloque) y el diccionario
+   LZW, vacío o cebado con la muestra del diccionario entrenado. Se reserva
+   en el primer bloque que la necesita y se reutiliza en los siguientes.
+   Cada hilo necesita el suyo */
+typedef struct _codificador {
+    tipoPaquetes paquetes;
+    std::vector<uint32_t> cuenta;       /* Pares de bytes: cuenta[256 * anterior + byte] */
+    std::vector<uint8_t> presentes;     /* Para AgruparContextos */
+    lzw::Compressor lzw;
+    std::unique_ptr<lzw::Compressor> lzwCebado;
+    uint32_t idCebado;                  /* Diccionario con el que se cebó lzwCebado */
+} tipoCodificador;
+
+/* Memoria de trabajo de un hilo que descomprime bloques: las tablas de
+   decodificación, que cada bloque reconstruye encima, el buffer de los
+   bloques que no caben enteros en el destino y los diccionarios LZW, vacío
+   y cebado. Cada hilo necesita el suyo */
+typedef struct _decodificador {
+    tipoTablaDecodificacion tablas[MAX_TABLAS_CONTEXTO];
+    std::vector<uint8_t> temporal;
+    lzw::Decompressor lzw;
+    std::unique_ptr<lzw::Decompressor> lzwCebado;
+    uint32_t idCebado;                  /* Diccionario con el que se cebó lzwCebado */
+} tipoDecodificador;
+
+/* Bytes que ocupan las rachas de al menos MIN_RACHA bytes iguales y número
+   de rachas, para estimar lo que ocuparía el bloque en modo MODO_RACHAS */
+static inline void MedirRachas(const uint8_t *src, size_t n, size_t *enRachas, size_t *nRachas) {
+    size_t i, r;
+
+    *enRachas = *nRachas = 0;
+    for(i = 0; i < n; i += r) {
+        for(r = 1; i + r < n && src[i + r] == src[i]; r++);
+        if(r >= MIN_RACHA) {
+            *enRachas += r;
+            (*nRachas)++;
+        }
+    }
+}
+
+/* Escribe n bytes literales. Devuelve la nueva posición o 0 si no caben */
+static inline size_t PonerLiterales(const uint8_t *src, size_t n, uint8_t *dst, size_t p, size_t limite) {
+    size_t m;
+
+    for(; n > 0; n -= m, src += m) {
+        m = n < MAX_LITERALES ? n : MAX_LITERALES;
+        if(p + 1 + m > limite) return 0;
+        dst[p++] = m - 1;
+        memcpy(dst + p, src, m);
+        p += m;
+    }
+    return p;
+}
+
+/* Codifica n bytes como rachas y literales sin pasar de limite bytes.
+   Devuelve los bytes escritos o 0 si no caben */
+static inline size_t CodificarRachas(const uint8_t *src, size_t n, uint8_t *dst, size_t limite) {
+    size_t i, r, k, inicio = 0, p = 0;
+
+    for(i = 0; i < n; i += r) {
+        for(r = 1; i + r < n && src[i + r] == src[i]; r++);
+        if(r < MIN_RACHA) continue;
+
+        /* Los literales pendientes y la racha; la longitud necesita como
+           mucho 10 bytes */
+        if(i > inicio && !(p = PonerLiterales(src + inicio, i - inicio, dst, p, limite))) return 0;
+        if(p + 12 > limite) return 0;
+        k = r - MIN_RACHA;
+        dst[p++] = 128 + (k < 127 ? k : 127);
+        dst[p++] = src[i];
+        if(k >= 127) {
+            for(k -= 127; k >= 128; k >>= 7) dst[p++] = (k & 127) | 128;
+            dst[p++] = k;
+        }
+        inicio = i + r;
+    }
+    if(n > inicio && !(p = PonerLiterales(src + inicio, n - inicio, dst, p, limite))) return 0;
+    return p;
+}
+
+/* Decodifica los n bytes de un bloque escrito con CodificarRachas. Devuelve
+   0, o -1 si los datos no son válidos */
+static inline int DecodificarRachas(const uint8_t *src, size_t tam, uint8_t *dst, size_t n) {
+    size_t p = 0, i = 0, m;
+    unsigned t, c, desplazamiento;
+
+    while(i < n) {
+        if(p >= tam) return -1;
+        t = src[p++];
+        if(t < 128) {
+            m = t + 1;
+            if(m > tam - p || m > n - i) return -1;
+            memcpy(dst + i, src + p, m);
+            p += m;
+        } else {
+            if(p >= tam) return -1;
+            c = src[p++];
+            m = t - 128 + MIN_RACHA;
+            if(t == 255) {
+                desplazamiento = 0;
+                do {
+                    if(p >= tam || desplazamiento > 28) return -1;
+                    m += (size_t)(src[p] & 127) << desplazamiento;
+                    desplazamiento += 7;
+                } while(src[p++] & 128);
+            }
+            if(m > n - i) return -1;
+            memset(dst + i, c, m);
+        }
+        i += m;
+    }
+    return p == tam ? 0 : -1;
+}
+
+/* Código Huffman estático de un diccionario entrenado (common/dictionary.hpp)
+   para los bloques MODO_ESTATICO, con las tablas ya construidas para no
+   rehacerlas en cada bloque. Sólo se lee, así que lo comparten los hilos */
+typedef struct _estatico {
+    uint32_t id;                            /* Identificador del diccionario */
+    unsigned char longitud[256];            /* Todos los bytes tienen código */
+    tipoCodigo codigos[256];
+    tipoTablaDecodificacion decodificacion;
+    std::vector<std::byte> muestra;         /* Ceba los diccionarios de los bloques MODO_LZW_CEBADO */
+} tipoEstatico;
+
+/* Prepara el código estático de un diccionario ya validado */
+static inline void CrearEstatico(const dictionary::Dictionary *d, tipoEstatico *e) {
+    e->id = d->id;
+    memcpy(e->longitud, d->lengths, 256);
+    CrearTablaCodigos(e->longitud, 256, e->codigos);
+    CrearTablaDecodificacion(e->longitud, 256, &e->decodificacion);
+    e->muestra = d->sample;
+}
+
+/* Lee un fichero de diccionario y prepara su código estático. Devuelve 0, o
+   -1 si no se puede leer o no es un diccionario válido */
+static inline int LeerDiccionario(const char *nombre, tipoEstatico *e) {
+    tipoEntrada entrada;
+    int r = 0;
+
+    if(AbrirEntrada(&entrada, nombre) < 0) return -1;
+    try {
+        dictionary::Dictionary d = dictionary::load(std::span<const std::byte>((const std::byte *)entrada.datos,
+                                                                               entrada.longitud));
+        CrearEstatico(&d, e);
+    } catch(const std::exception &) {
+        r = -1;
+    }
+    CerrarEntrada(&entrada);
+    return r;
+}
+
+/* Intenta codificar el bloque con LZW en menos de limite bytes. Sin código
+   estático usa el diccionario vacío de codificador (MODO_LZW: modo y anchura
+   máxima); con él, el cebado con su muestra (MODO_LZW_CEBADO: modo,
+   identificador del diccionario y anchura), que se prepara la primera vez.
+   Devuelve los bytes escritos o 0 si no caben */
+static inline size_t CodificarLZW(const uint8_t *src, size_t n, uint8_t *dst, size_t limite,
+                                  const tipoEstatico *estatico, tipoCodificador *codificador) {
+    lzw::Compressor *lzw = &codificador->lzw;
+    size_t p = 0;
+
+    if(limite < 6) return 0;
+    if(estatico) {
+        if(!codificador->lzwCebado || codificador->idCebado != estatico->id) {
+            codificador->lzwCebado = std::make_unique<lzw::Compressor>(lzw->width(), estatico->muestra);
+            codificador->idCebado = estatico->id;
+        }
+        lzw = codificador->lzwCebado.get();
+        dst[p++] = MODO_LZW_CEBADO;
+        EscribirU32(dst + p, estatico->id);
+        p += 4;
+    } else
+        dst[p++] = MODO_LZW;
+    dst[p++] = lzw->width();
+    try {
+        return p + lzw->compress_chunk(std::span<const std::byte>((const std::byte *)src, n),
+                                       std::span<std::byte>((std::byte *)dst + p, limite - p));
+    } catch(const std::length_error &) {
+        return 0;
+    }
+}
+
+/* Tamaño exacto de un bloque MODO_ESTATICO con esas frecuencias */
+static inline size_t TamBloqueEstatico(const unsigned long int frecuencia[256], const tipoEstatico *e) {
+    uint64_t bits = 0;
+
+    for(int c = 0; c < 256; c++) bits += (uint64_t)frecuencia[c] * e->longitud[c];
+    return 5 + (bits + 7) / 8;
+}
+
+/* Escribe un bloque MODO_ESTATICO: modo, identificador del diccionario y un
+   flujo de bits con su código. dst necesita COTA_BLOQUE(n) bytes. Devuelve
+   los bytes escritos */
+static inline size_t CodificarEstatico(const uint8_t *src, size_t n, const tipoEstatico *e, uint8_t *dst) {
+    stats::Timer t(stats::encode);
+    tipoEscritor escritor;
+
+    dst[0] = MODO_ESTATICO;
+    EscribirU32(dst + 1, e->id);
+    IniciarEscritor(&escritor, dst + 5);
+    CodificarHuffman(&escritor, src, n, e->codigos, e->decodificacion.maxBits);
+    TerminarBits(&escritor);
+    stats::add(stats::symbols, n);
+    stats::add(stats::bits, 8 * (escritor.p - dst - 5));
+    return escritor.p - dst;
+}
+
+/* Decodifica un bloque MODO_ESTATICO, que sólo es válido con el diccionario
+   con el que se escribió. Devuelve 0, ERROR_DICCIONARIO si e es NULL u otro
+   diccionario, o -1 si el bloque no es válido */
+static inline int DecodificarEstatico(const uint8_t *src, size_t tam, uint8_t *dst, size_t n,
+                                      const tipoEstatico *e) {
+    tipoLector l;
+
+    if(tam < 5) return -1;
+    if(!e || LeerU32(src + 1) != e->id) return ERROR_DICCIONARIO;
+    IniciarLector(&l, src + 5, src + tam);
+    DecodificarHuffman(&l, dst, n, &e->decodificacion);
+    stats::add(stats::symbols, n);
+    stats::add(stats::bits, 8 * (tam - 5));
+    return LectorAgotado(&l) ? -1 : 0;
+}
+
+/* Comprime un bloque con el modo que menos ocupa según una estimación
+   barata: el tamaño Huffman sale de las longitudes de los códigos sin
+   codificar nada, el de las rachas de medirlas, y el de LZW de comprimir
+   una muestra del principio del bloque. Los bloques casi aleatorios (ya
+   comprimidos, por ejemplo) se guardan tal cual sin construir ningún
+   código. flujos (1 o 4) se aplica a los bloques Huffman. Con un código
+   estático (o NULL si no hay diccionario), los bloques Huffman lo usan si
+   ocupa menos que una tabla propia, lo que en bloques pequeños es casi
+   siempre, y los LZW parten de su muestra. dst necesita COTA_BLOQUE(n) bytes. Devuelve los bytes escritos */
+static inline size_t ComprimirBloqueAuto(const uint8_t *src, size_t n, int maxBits, int flujos,
+                                         const tipoEstatico *estatico, tipoCodificador *codificador,
+                                         uint8_t *dst) {
+    unsigned long int frecuencia[256];
+    unsigned char longitud[256];
+    size_t enRachas, nRachas, literales, tamHuffman, tamRachas, mejor, muestra, tam = 0;
+    int modo, modoHuffman = flujos;
+
+    {
+        stats::Timer t(stats::count);
+        Cuenta(src, n, frecuencia);
+        MedirRachas(src, n, &enRachas, &nRachas);
+    }
+    {
+        stats::Timer t(stats::build);
+        LongitudesHuffman(frecuencia, 256, maxBits, longitud, &codificador->paquetes);
+    }
+
+    /* Cada racha lleva su control, su byte y, a menudo, el control de los
+       literales que la siguen */
+    literales = n - enRachas;
+    tamRachas = 1 + literales + literales / MAX_LITERALES + 3 * nRachas;
+    tamHuffman = TamBloqueHuffman(frecuencia, longitud, flujos);
+    if(estatico && TamBloqueEstatico(frecuencia, estatico) <= tamHuffman) {
+        tamHuffman = TamBloqueEstatico(frecuencia, estatico);
+        modoHuffman = MODO_ESTATICO;
+    }
+    modo = tamRachas < tamHuffman ? MODO_RACHAS : modoHuffman;
+    mejor = tamRachas < tamHuffman ? tamRachas : tamHuffman;
+
+    /* LZW sólo puede ganar si hay algo que comprimir; la muestra se estima
+       a la baja, porque el diccionario todavía no ha aprendido del bloque */
+    if(mejor < n - n / AHORRO_MINIMO) {
+        stats::Timer t(stats::encode);
+        muestra = n < TAM_MUESTRA_LZW ? n : TAM_MUESTRA_LZW;
+        tam = CodificarLZW(src, muestra, dst, COTA_BLOQUE(n), estatico, codificador);
+        if(tam && (double)tam * n / muestra < mejor) {
+            tam = CodificarLZW(src, n, dst, mejor, estatico, codificador);
+            if(tam) modo = estatico ? MODO_LZW_CEBADO : MODO_LZW;
+        }
+    }
+
+    if(modo != MODO_LZW && modo != MODO_LZW_CEBADO && mejor >= n - n / AHORRO_MINIMO) modo = MODO_CRUDO;
+    if(modo == MODO_RACHAS) {
+        stats::Timer t(stats::encode);
+        dst[0] = MODO_RACHAS;
+        tam = CodificarRachas(src, n, dst + 1, n - n / AHORRO_MINIMO);
+        if(tam) tam++;
+        else modo = tamHuffman < n - n / AHORRO_MINIMO ? modoHuffman : MODO_CRUDO;
+    }
+    if(modo == MODO_HUFFMAN || modo == MODO_HUFFMAN4) tam = CodificarBloque(src, n, longitud, maxBits, flujos, dst);
+    if(modo == MODO_ESTATICO) tam = CodificarEstatico(src, n, estatico, dst);
+    if(modo == MODO_CRUDO) {
+        stats::Timer t(stats::encode);
+        dst[0] = MODO_CRUDO;
+        memcpy(dst + 1, src, n);
+        tam = 1 + n;
+    }
+    stats::add(stats::bytes_in, n);
+    stats::add(stats::bytes_out, tam);
+    return tam;
+}
+
+/* Comprime un bloque con Huffman de orden 1 (MODO_CONTEXTO): modo, número
+   de tablas, mapa de contexto a tabla (cuatro bits por contexto), las
+   longitudes de cada tabla y un flujo de bits. Si una sola tabla ocupa
+   menos, el bloque es Huffman normal de un flujo, y si ninguno ahorra lo
+   suficiente se guarda tal cual. dst necesita COTA_BLOQUE(n) bytes.
+   Devuelve los bytes escritos */
+static inline size_t ComprimirBloqueContexto(const uint8_t *src, size_t n, int maxBits,
+                                             tipoCodificador *codificador, uint8_t *dst) {
+    std::vector<uint32_t> &cuenta = codificador->cuenta;
+    unsigned long int frecuencia[MAX_TABLAS_CONTEXTO][256], total[256];
+    unsigned char longitud[MAX_TABLAS_CONTEXTO][256], longitud0[256];
+    tipoCodigo codigos[MAX_TABLAS_CONTEXTO][256];
+    const tipoCodigo *tablas[256];
+    uint8_t mapa[256], *p = dst;
+    uint64_t bits = 0;
+    size_t tam, tam0;
+    int nTablas, k, s, presentes, maximo = 0;
+
+    {
+        stats::Timer t(stats::count);
+        cuenta.resize(256 * 256);
+        CuentaContextos(src, n, &cuenta[0]);
+    }
+    {
+        stats::Timer t(stats::build);
+        nTablas = AgruparContextos(&cuenta[0], MAX_TABLAS_CONTEXTO, mapa, frecuencia, &codificador->presentes);
+        for(k = 0; k < nTablas; k++) {
+            s = LongitudesHuffman(frecuencia[k], 256, maxBits, longitud[k], &codificador->paquetes);
+            if(s > maximo) maximo = s;
+        }
+    }
+
+    /* El tamaño exacto sale de las longitudes, como en TamBloqueHuffman */
+    tam = 2 + TAM_MAPA_CONTEXTOS;
+    for(k = 0; k < nTablas; k++) {
+        presentes = 0;
+        for(s = 0; s < 256; s++) {
+            bits += (uint64_t)frecuencia[k][s] * longitud[k][s];
+            presentes += longitud[k][s] != 0;
+        }
+        tam += 32 + (presentes + 1) / 2;
+    }
+    tam += (bits + 7) / 8;
+
+    /* En bloques pequeños o sin relación entre bytes vecinos, el mapa y las
+       tablas pueden costar más de lo que ahorran: entonces basta una tabla
+       de orden 0, que sale de sumar los contextos */
+    {
+        stats::Timer t(stats::build);
+        memset(total, 0, sizeof(total));
+        for(k = 0; k < nTablas; k++)
+            for(s = 0; s < 256; s++) total[s] += frecuencia[k][s];
+        LongitudesHuffman(total, 256, maxBits, longitud0, &codificador->paquetes);
+    }
+    tam0 = TamBloqueHuffman(total, longitud0, 1);
+    if(tam0 <= tam && tam0 < n - n / AHORRO_MINIMO) {
+        tam = CodificarBloque(src, n, longitud0, maxBits, 1, dst);
+        stats::add(stats::bytes_in, n);
+        stats::add(stats::bytes_out, tam);
+        return tam;
+    }
+
+    if(tam >= n - n / AHORRO_MINIMO) {
+        stats::Timer t(stats::encode);
+        dst[0] = MODO_CRUDO;
+        memcpy(dst + 1, src, n);
+        tam = 1 + n;
+    } else {
+        tipoEscritor e;
+
+        {
+            stats::Timer t(stats::build);
+            for(k = 0; k < nTablas; k++) CrearTablaCodigos(longitud[k], 256, codigos[k]);
+            for(s = 0; s < 256; s++) tablas[s] = codigos[mapa[s]];
+        }
+        {
+            stats::Timer t(stats::table);
+            *p++ = MODO_CONTEXTO;
+            *p++ = nTablas;
+            for(s = 0; s < 256; s += 2) *p++ = mapa[s] | mapa[s+1] << 4;
+            for(k = 0; k < nTablas; k++) p += EscribirLongitudes(p, longitud[k], 256);
+        }
+        {
+            stats::Timer t(stats::encode);
+            IniciarEscritor(&e, p);
+            CodificarContexto(&e, src, n, tablas, maximo);
+            TerminarBits(&e);
+            tam = e.p - dst;
+        }
+        stats::add(stats::symbols, n);
+        stats::add(stats::bits, 8 * (tam - (p - dst)));
+    }
+    stats::add(stats::bytes_in, n);
+    stats::add(stats::bytes_out, tam);
+    return tam;
+}
+
+/* Descomprime un bloque MODO_CONTEXTO de tam bytes con n bytes originales
+   sobre las MAX_TABLAS_CONTEXTO tablas de decodificación que se pasan.
+   Devuelve 0, o -1 si el bloque no es válido */
+static inline int DescomprimirBloqueContexto(const uint8_t *src, size_t tam, uint8_t *dst, size_t n,
+                                             tipoTablaDecodificacion *tabla) {
+    const tipoEntradaTabla *tablas[256];
+    unsigned char longitud[256];
+    uint8_t mapa[256];
+    tipoLector l;
+    size_t p;
+    long nTabla;
+    int nTablas, k, s, maximo = 0;
+
+    if(tam < 2 + TAM_MAPA_CONTEXTOS) return -1;
+    nTablas = src[1];
+    if(nTablas < 1 || nTablas > MAX_TABLAS_CONTEXTO) return -1;
+    {
+        stats::Timer t(stats::table);
+        for(s = 0; s < 256; s += 2) {
+            mapa[s] = src[2 + s / 2] & 0x0F;
+            mapa[s+1] = src[2 + s / 2] >> 4;
+            if(mapa[s] >= nTablas || mapa[s+1] >= nTablas) return -1;
+        }
+        p = 2 + TAM_MAPA_CONTEXTOS;
+        for(k = 0; k < nTablas; k++) {
+            nTabla = LeerLongitudes(src + p, tam - p, longitud, 256);
+            if(nTabla < 0) return -1;
+            p += nTabla;
+            CrearTablaDecodificacion(longitud, 256, &tabla[k]);
+            if(tabla[k].maxBits > maximo) maximo = tabla[k].maxBits;
+        }
+        for(s = 0; s < 256; s++) tablas[s] = tabla[mapa[s]].entradas;
+    }
+
+    stats::add(stats::bytes_in, tam);
+    {
+        stats::Timer t(stats::decode);
+        IniciarLector(&l, src + p, src + tam);
+        DecodificarContexto(&l, dst, n, tablas, maximo);
+    }
+    stats::add(stats::bytes_out, n);
+    stats::add(stats::symbols, n);
+    stats::add(stats::bits, 8 * (tam - p));
+    return LectorAgotado(&l) ? -1 : 0;
+}
+
+/* Descomprime un bloque de cualquier modo, de tam bytes, que contiene n bytes
+   originales, con la memoria de trabajo de decodificador. Los bloques
+   MODO_ESTATICO y MODO_LZW_CEBADO necesitan su diccionario; estatico puede
+   ser NULL si no hay. Devuelve 0, ERROR_DICCIONARIO si falta el diccionario
+   del bloque, o -1 si el bloque no es válido */
+static inline int DescomprimirBloqueAuto(const uint8_t *src, size_t tam, uint8_t *dst, size_t n,
+                                         tipoDecodificador *decodificador, const tipoEstatico *estatico) {
+    int r = 0;
+
+    if(tam < 1) return -1;
+    if(src[0] == MODO_HUFFMAN || src[0] == MODO_HUFFMAN4)
+        return DescomprimirBloque(src, tam, dst, n, decodificador->tablas);
+    if(src[0] == MODO_CONTEXTO) return DescomprimirBloqueContexto(src, tam, dst, n, decodificador->tablas);
+
+    {
+        stats::Timer t(stats::decode);
+        switch(src[0]) {
+        case MODO_CRUDO:
+            if(tam - 1 != n) return -1;
+            memcpy(dst, src + 1, n);
+            break;
+        case MODO_RACHAS:
+            r = DecodificarRachas(src + 1, tam - 1, dst, n);
+            break;
+        case MODO_ESTATICO:
+            r = DecodificarEstatico(src, tam, dst, n, estatico);
+            break;
+        case MODO_LZW:
+            if(tam < 2 || src[1] < lzw::globals::min_width || src[1] > lzw::globals::max_width) return -1;
+            try {
+                decodificador->lzw.set_width(src[1]);
+                decodificador->lzw.decompress_chunk(std::span<const std::byte>((const std::byte *)src + 2, tam - 2),
+                                                    std::span<std::byte>((std::byte *)dst, n));
+            } catch(const std::exception &) {
+                return -1;
+            }
+            break;
+        case MODO_LZW_CEBADO:
+            if(tam < 6) return -1;
+            if(!estatico || LeerU32(src + 1) != estatico->id) return ERROR_DICCIONARIO;
+            if(src[5] < lzw::globals::min_width || src[5] > lzw::globals::max_width) return -1;
+            try {
+                /* El diccionario cebado no cambia de anchura: se rehace si el
+                   bloque usa otra */
+                if(!decodificador->lzwCebado || decodificador->idCebado != estatico->id ||
+                   decodificador->lzwCebado->width() != src[5]) {
+                    decodificador->lzwCebado = std::make_unique<lzw::Decompressor>(src[5], estatico->muestra);
+                    decodificador->idCebado = estatico->id;
+                }
+                decodificador->lzwCebado->decompress_chunk(std::span<const std::byte>((const std::byte *)src + 6, tam - 6),
+                                                           std::span<std::byte>((std::byte *)dst, n));
+            } catch(const std::exception &) {
+                return -1;
+            }
+            break;
+        default:
+            return -1;
+        }
+    }
+    stats::add(stats::bytes_in, tam);
+    stats::add(stats::bytes_out, n);
+    return r;
+}
+
+/* Descomprime el bloque i en la parte que le corresponde de dst, que recibe
+   los bytes originales [inicio, inicio + n). Si el bloque entero está en el
+   rango se descomprime en su sitio; si no, pasa por el buffer temporal del
+   decodificador y sólo se copia la parte pedida. Devuelve lo mismo que
+   DescomprimirBloqueAuto */
+static inline int DescomprimirBloqueDelRango(const uint8_t *datos, size_t tam, const tipoIndice *indice,
+                                             size_t i, uint64_t inicio, uint64_t n, uint8_t *dst,
+                                             tipoDecodificador *decodificador, const tipoEstatico *estatico) {
+    std::vector<uint8_t> *temporal = &decodificador->temporal;
+    const tipoBloque *b = &indice->bloques[i];
+    uint64_t desde, hasta;
+    int r;
+
+    if(b->posicion + b->tam > tam) return -1;
+    ParteDelBloque(b, inicio, n, &desde, &hasta);
+    if(desde == 0 && hasta == b->longitud)
+        return DescomprimirBloqueAuto(datos + b->posicion, b->tam, dst + (b->inicio - inicio), b->longitud,
+                                      decodificador, estatico);
+
+    temporal->resize(b->longitud);
+    r = DescomprimirBloqueAuto(datos + b->posicion, b->tam, &(*temporal)[0], b->longitud, decodificador, estatico);
+    if(r < 0) return r;
+    memcpy(dst + (b->inicio + desde - inicio), &(*temporal)[desde], hasta - desde);
+    return 0;
+}
+
+/* Descomprime sólo los bytes originales [inicio, inicio + n) de un fichero
+   comprimido completo en memoria, tocando únicamente los bloques que los
+   contienen. dst necesita n bytes; si el rango pasa del final se recorta y
+   *escritos indica cuántos se han obtenido. Devuelve 0, ERROR_DICCIONARIO
+   si falta el diccionario de algún bloque, o -1 si el fichero no es válido
+   o inicio está fuera de él */
+static inline int DescomprimirRango(const uint8_t *datos, size_t tam, const tipoIndice *indice,
+                                    uint64_t inicio, uint64_t n, uint8_t *dst, uint64_t *escritos,
+                                    tipoDecodificador *decodificador, const tipoEstatico *estatico) {
+    size_t primero, ultimo, i;
+    int r;
+
+    *escritos = 0;
+    if(RecortarRango(indice, inicio, &n) < 0) return -1;
+    BloquesDelRango(indice, inicio, n, &primero, &ultimo);
+
+    for(i = primero; i < ultimo; i++) {
+        r = DescomprimirBloqueDelRango(datos, tam, indice, i, inicio, n, dst, decodificador, estatico);
+        if(r < 0) return r;
+    }
+    *escritos = n;
+    return 0;
+}
+
+#endif
@@ -1,277 +1,159 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <chrono>
+#include <string.h>
 #include <vector>
-#include <fstream>
-#include <iostream>
+#include "bloque.h"
+#include "../common/pipeline.hpp"
 
 using namespace std;
 
-/* Tipo nodo para árbol o Lista de árboles */
-typedef struct _nodo {
-    unsigned char letra;    /* Letra a la que hace referencia el nodo */
-    int frecuencia;         /* Veces que aparece la letra en el texto o las letras */
-    struct _nodo *sig;      /* Puntero a siguiente nodo de una lista enlazada */
-    struct _nodo *cero;     /* Puntero a la rama cero de un árbol */
-    struct _nodo *uno;      /* Puntero a la rama uno de un árbol */
-} tipoNodo;
+STATS_COUNT_ALLOCATIONS()
 
-/* Nodo para construir una lista para la tabla de codigos */
-typedef struct _tabla {
-    unsigned char letra;    /* Letra a la que hace referencia el nodo */
-    unsigned long int bits; /* Valor de la codificación de la letra */
-    unsigned char nbits;    /* Número de bits de la codificación */
-    struct _tabla *sig;     /* Siguiente elemento de la tabla */
-} tipoTabla;
-
-/* Variables globales */
-tipoTabla *Tabla;
-
-/* Prototipos */
-void Cuenta(tipoNodo** Lista, unsigned char c);
-void Ordenar(tipoNodo** Lista);
-void InsertarOrden(tipoNodo** Cabeza, tipoNodo *e);
-void BorrarArbol(tipoNodo *n);
-void CrearTabla(tipoNodo *n, int l, int v);
-void InsertarTabla(unsigned char c, int l, int v);
-tipoTabla *BuscaCaracter(tipoTabla *Tabla, unsigned char c);
+/* Código estático del diccionario de -d; es grande para la pila */
+static tipoEstatico diccionario;
 
 int main(int argc, char *argv[]) {
-    tipoNodo *Lista, *Arbol;
+    uint8_t cabecera[TAM_CABECERA];
+    vector<tipoBloque> bloques;
+    vector<uint8_t> indice;
+    uint64_t posicion, inicio;
     FILE *fe, *fs;
-    unsigned char c;
-    tipoNodo *p;
-    tipoTabla *t;
-    int nElementos;
-    long int Longitud;
-    unsigned long int dWORD;
-    int nBits;
-
-    if(argc < 3) {
-        printf("Usar:\n%s <fichero_entrada> <fichero_salida>\n", argv[0]);
-        return 1;
-    }
-
-    vector<double> tiempos;
-    for (int iter = 0; iter < 4; ++iter) {
-        auto start =chrono::high_resolution_clock::now();
-
-        Lista = NULL;
-        Longitud = 0;
-
-        /* Fase 1: contar frecuencias */
-        fe = fopen(argv[1], "r");
-        do {
-            c = fgetc(fe);
-            if(feof(fe)) break;
-            Longitud++;
-            Cuenta(&Lista, c);
-        } while(1);
-        fclose(fe);
-
-        /* Ordenar la lista de menor a mayor */
-        Ordenar(&Lista);
-
-        /* Crear el arbol */
-        Arbol = Lista;
-        while(Arbol && Arbol->sig) {
-            p = (tipoNodo *)malloc(sizeof(tipoNodo));
-            p->letra = 0;
-            p->uno = Arbol;
-            Arbol = Arbol->sig;
-            p->cero = Arbol;
-            Arbol = Arbol->sig;
-            p->frecuencia = p->uno->frecuencia + p->cero->frecuencia;
-            InsertarOrden(&Arbol, p);
-        }
-
-        /* Construir la tabla de códigos binarios */
-        Tabla = NULL;
-        CrearTabla(Arbol, 0, 0);
-
-        /* Crear fichero comprimido */
-        fs = fopen(argv[2], "wb");
-        fwrite(&Longitud, sizeof(long int), 1, fs);
-
-        /* Cuenta el número de elementos de tabla */
-        nElementos = 0;
-        t = Tabla;
-        while(t) {
-            nElementos++;
-            t = t->sig;
-        }
-        fwrite(&nElementos, sizeof(int), 1, fs);
-
-        /* Escribir tabla en fichero */
-        t = Tabla;
-        while(t) {
-            fwrite(&t->letra, sizeof(char), 1, fs);
-            fwrite(&t->bits, sizeof(unsigned long int), 1, fs);
-            fwrite(&t->nbits, sizeof(char), 1, fs);
-            t = t->sig;
-        }
-
-        /* Codificación del fichero de entrada */
-        fe = fopen(argv[1], "r");
-        dWORD = 0;
-        nBits = 0;
-        do {
-            c = fgetc(fe);
-            if(feof(fe)) break;
-            t = BuscaCaracter(Tabla, c);
-            while(nBits + t->nbits > 32) {
-                c = dWORD >> (nBits-8);
-                fwrite(&c, sizeof(char), 1, fs);
-                nBits -= 8;
+    int errorLectura;
+    int maxBits = BITS_HUFFMAN;
+    int flujos = 1;
+    int modo = -1;          /* MODO_HUFFMAN, MODO_CONTEXTO, o -1 para elegirlo en cada bloque */
+    const tipoEstatico *estatico = NULL;    /* Diccionario entrenado, si lo hay */
+    unsigned hilos = parallel::default_workers();
+    int estadisticas = 0;
+    int arg = 1;
+
+    /* Opciones */
+    while(arg < argc && argv[arg][0] == '-') {
+        if(!strcmp(argv[arg], "-b") && arg + 1 < argc) {
+            maxBits = atoi(argv[arg+1]);
+            arg += 2;
+        } else if(!strcmp(argv[arg], "-j") && arg + 1 < argc) {
+            hilos = atoi(argv[arg+1]);
+            arg += 2;
+        } else if(!strcmp(argv[arg], "-m") && arg + 1 < argc) {
+            if(!strcmp(argv[arg+1], "auto")) modo = -1;
+            else if(!strcmp(argv[arg+1], "huffman")) modo = MODO_HUFFMAN;
+            else if(!strcmp(argv[arg+1], "contexto")) modo = MODO_CONTEXTO;
+            else break;
+            arg += 2;
+        } else if(!strcmp(argv[arg], "-d") && arg + 1 < argc) {
+            if(LeerDiccionario(argv[arg+1], &diccionario) < 0) {
+                fprintf(stderr, "%s no es un diccionario válido\n", argv[arg+1]);
+                return 1;
             }
-            dWORD <<= t->nbits;
-            dWORD |= t->bits;
-            nBits += t->nbits;
-        } while(1);
-
-        while(nBits > 0) {
-            if(nBits >= 8) c = dWORD >> (nBits-8);
-            else c = dWORD << (8-nBits);
-            fwrite(&c, sizeof(char), 1, fs);
-            nBits -= 8;
-        }
-
-        fclose(fe);
-        fclose(fs);
-
-        BorrarArbol(Arbol);
-
-        while(Tabla) {
-            t = Tabla;
-            Tabla = t->sig;
-            free(t);
-        }
-
-        auto end =chrono::high_resolution_clock::now();
-        chrono::duration<double> elapsed = end - start;
-        tiempos.push_back(elapsed.count());
-
-        // Imprimir el tiempo en la terminal
-        cout << "Iteracion " << iter + 1 << ": " << elapsed.count() << " segundos" << std::endl;
-    }
-
-    // Calcular el promedio
-    double suma = 0;
-    for(const auto& tiempo : tiempos) {
-        suma += tiempo;
+            estatico = &diccionario;
+            arg += 2;
+        } else if(!strcmp(argv[arg], "-4")) {
+            flujos = 4;
+            arg++;
+        } else if(!strcmp(argv[arg], "--stats")) {
+            estadisticas = 1;
+            arg++;
+        } else break;
     }
-    double promedio = suma / tiempos.size();
-
-    // Escribir tiempos y promedio en el archivo CSV
-    ofstream file("tiemposCodificar.csv");
-    for (const auto& tiempo : tiempos) {
-        file << tiempo << "\n";
+    if(argc - arg < 2 || maxBits < MIN_BITS_HUFFMAN || maxBits > MAX_BITS_HUFFMAN || hilos < 1
+       || (estatico && modo != -1)) {
+        fprintf(stderr, "Usar:\n%s [-b bits] [-m modo] [-d diccionario] [-4] [-j hilos] [--stats] <fichero_entrada> <fichero_salida>\n",
+                       argv[0]);
+        fprintf(stderr, "  -b bits   longitud máxima de los códigos (%d a %d, por defecto %d)\n",
+                       MIN_BITS_HUFFMAN, MAX_BITS_HUFFMAN, BITS_HUFFMAN);
+        fprintf(stderr, "  -m modo   auto (por defecto) elige para cada bloque entre guardarlo tal cual,\n");
+        fprintf(stderr, "            rachas, Huffman o LZW; huffman usa siempre Huffman; contexto usa\n");
+        fprintf(stderr, "            Huffman de orden 1, con tablas según el byte anterior\n");
+        fprintf(stderr, "  -d dic    con el modo auto, los bloques Huffman pueden usar el código del\n");
+        fprintf(stderr, "            diccionario entrenado dic en vez de llevar su tabla y los LZW\n");
+        fprintf(stderr, "            parten de su muestra; hay que pasar el mismo diccionario al\n");
+        fprintf(stderr, "            descomprimir\n");
+        fprintf(stderr, "  -4        cuatro flujos de bits entrelazados por bloque Huffman\n");
+        fprintf(stderr, "  -j hilos  bloques que se comprimen en paralelo (por defecto %u)\n",
+                       parallel::default_workers());
+        fprintf(stderr, "  --stats   tiempo de cada fase y contadores\n");
+        return 1;
     }
-    file << "Promedio," << promedio << "\n";
-    file.close();
-
-    return 0;
-}
 
-void Cuenta(tipoNodo** Lista, unsigned char c) {
-    tipoNodo *p, *a, *q;
+    /* La memoria de trabajo de cada hilo, que se reutiliza de un bloque a
+       otro */
+    vector<tipoCodificador> codificadores(hilos);
 
-    if(!*Lista) {
-        *Lista = (tipoNodo *)malloc(sizeof(tipoNodo));
-        (*Lista)->letra = c;
-        (*Lista)->frecuencia = 1;
-        (*Lista)->sig = (*Lista)->cero = (*Lista)->uno = NULL;
-    } else {
-        p = *Lista;
-        a = NULL;
-        while(p && p->letra < c) {
-            a = p;
-            p = p->sig;
-        }
-        if(p && p->letra == c) p->frecuencia++;
-        else {
-            q = (tipoNodo *)malloc(sizeof(tipoNodo));
-            q->letra = c;
-            q->frecuencia = 1;
-            q->cero = q->uno = NULL;
-            q->sig = p;
-            if(a) a->sig = q;
-            else *Lista = q;
-        }
+    /* Abrir el original y crear el fichero comprimido */
+    fe = fopen(argv[arg], "rb");
+    if(!fe) {
+        fprintf(stderr, "No se puede leer %s\n", argv[arg]);
+        return 1;
     }
-}
-
-void Ordenar(tipoNodo** Lista) {
-    tipoNodo *Lista2, *a;
-
-    if(!*Lista) return;
-    Lista2 = *Lista;
-    *Lista = NULL;
-    while(Lista2) {
-        a = Lista2;
-        Lista2 = a->sig;
-        InsertarOrden(Lista, a);
+    fs = fopen(argv[arg+1], "wb");
+    if(!fs) {
+        fprintf(stderr, "No se puede crear %s\n", argv[arg+1]);
+        return 1;
     }
-}
-
-void InsertarOrden(tipoNodo** Cabeza, tipoNodo *e) {
-    tipoNodo *p, *a;
-
-    if(!*Cabeza) {
-        *Cabeza = e;
-        (*Cabeza)->sig = NULL;
-    } else {
-        p = *Cabeza;
-        a = NULL;
-        while(p && p->frecuencia < e->frecuencia) {
-            a = p;
-            p = p->sig;
-        }
-        e->sig = p;
-        if(a) a->sig = e;
-        else *Cabeza = e;
+    EscribirCabecera(cabecera, TAM_BLOQUE);
+    fwrite(cabecera, 1, TAM_CABECERA, fs);
+    posicion = TAM_CABECERA;
+    inicio = 0;
+    errorLectura = 0;
+
+    /* Un hilo lee el fichero por bloques, el grupo de hilos comprime cada
+       bloque por su cuenta y otro hilo escribe los resultados en
+       orden. Mientras se comprime un bloque ya se está leyendo el
+       siguiente y escribiendo el anterior, y los buffers de los bloques
+       se reutilizan de uno a otro */
+    pipeline::run(hilos, 2 * hilos,
+        [&](pipeline::Block &b) {
+            stats::Timer t(stats::read);
+            b.data.resize(TAM_BLOQUE);
+            b.size = fread(&b.data[0], 1, TAM_BLOQUE, fe);
+            if(ferror(fe)) errorLectura = 1;
+            return b.size > 0;
+        },
+        [&](unsigned hilo, pipeline::Block &b, pipeline::Block &c) {
+            tipoCodificador *codificador = &codificadores[hilo];
+            c.data.resize(COTA_BLOQUE(TAM_BLOQUE));
+            if(modo == MODO_CONTEXTO)
+                c.size = ComprimirBloqueContexto((const uint8_t *)&b.data[0], b.size, maxBits, codificador,
+                                                 (uint8_t *)&c.data[0]);
+            else if(modo == MODO_HUFFMAN)
+                c.size = ComprimirBloque((const uint8_t *)&b.data[0], b.size, maxBits, flujos,
+                                         &codificador->paquetes, (uint8_t *)&c.data[0]);
+            else
+                c.size = ComprimirBloqueAuto((const uint8_t *)&b.data[0], b.size, maxBits, flujos, estatico,
+                                             codificador, (uint8_t *)&c.data[0]);
+        },
+        [&](pipeline::Block &c) {
+            stats::Timer t(stats::write);
+            tipoBloque b;
+            b.posicion = posicion;
+            b.tam = c.size;
+            b.inicio = inicio;
+            b.longitud = c.input_size;
+            bloques.push_back(b);
+            fwrite(&c.data[0], 1, c.size, fs);
+            posicion += c.size;
+            inicio += c.input_size;
+        });
+    fclose(fe);
+    if(errorLectura) {
+        fprintf(stderr, "No se puede leer %s\n", argv[arg]);
+        return 1;
     }
-}
-
-void CrearTabla(tipoNodo *n, int l, int v) {
-    if(n->uno) CrearTabla(n->uno, l+1, (v<<1)|1);
-    if(n->cero) CrearTabla(n->cero, l+1, v<<1);
-    if(!n->uno && !n->cero) InsertarTabla(n->letra, l, v);
-}
-
-void InsertarTabla(unsigned char c, int l, int v) {
-    tipoTabla *t, *p, *a;
 
-    t = (tipoTabla *)malloc(sizeof(tipoTabla));
-    t->letra = c;
-    t->bits = v;
-    t->nbits = l;
-
-    if(!Tabla) {
-        Tabla = t;
-        Tabla->sig = NULL;
-    } else {
-        p = Tabla;
-        a = NULL;
-        while(p && p->letra < t->letra) {
-            a = p;
-            p = p->sig;
-        }
-        t->sig = p;
-        if(a) a->sig = t;
-        else Tabla = t;
+    /* Índice de bloques al final del fichero */
+    {
+        stats::Timer t(stats::write);
+        indice.resize(bloques.size() * TAM_ENTRADA_INDICE + TAM_PIE);
+        fwrite(&indice[0], 1, EscribirIndice(&indice[0], bloques.data(), bloques.size(), posicion), fs);
+        fclose(fs);
     }
-}
 
-tipoTabla *BuscaCaracter(tipoTabla *Tabla, unsigned char c) {
-    tipoTabla *t;
-    t = Tabla;
-    while(t && t->letra != c) t = t->sig;
-    return t;
-}
+    /* Fases y contadores */
+    if(estadisticas) {
+        if(stats::enabled) stats::print(stderr, stats::collect());
+        else fprintf(stderr, "Las estadísticas necesitan compilar con -DCODEC_STATS\n");
+    }
 
-void BorrarArbol(tipoNodo *n) {
-    if(n->cero) BorrarArbol(n->cero);
-    if(n->uno) BorrarArbol(n->uno);
-    free(n);
+    return 0;
 }
@@ -1,151 +1,190 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <chrono>
+#include <string.h>
 #include <vector>
-#include <fstream>
-#include <iostream>
-#include <numeric> 
+#include <atomic>
+#include "fichero.h"
+#include "bloque.h"
+#include "../common/pipeline.hpp"
 using namespace std;
 
-/* Tipo nodo para árbol */
-typedef struct _nodo {
-   unsigned char letra;           /* Letra a la que hace referencia el nodo */
-   unsigned long int bits;        /* Valor de la codificación de la letra */
-   char nbits;                    /* Número de bits de la codificación */
-   struct _nodo *cero;            /* Puntero a la rama cero de un árbol */
-   struct _nodo *uno;             /* Puntero a la rama uno de un árbol */
-} tipoNodo;                       /* Nombre del tipo */
+STATS_COUNT_ALLOCATIONS()
 
-/* Funciones prototipo */
-void BorrarArbol(tipoNodo *n);
+/* Código estático del diccionario de -d; es grande para la pila */
+static tipoEstatico diccionario;
 
 int main(int argc, char *argv[]) {
-   if(argc < 3) {
-      printf("Usar:\n%s <fichero_entrada> <fichero_salida>\n", argv[0]);
+   unsigned hilos = parallel::default_workers();
+   unsigned long long desde = 0, cuantos = 0;
+   int rango = 0;          /* Sólo se pide una parte del fichero original */
+   const tipoEstatico *estatico = NULL;    /* Diccionario entrenado, si lo hay */
+   int estadisticas = 0;
+   int opcionValida = 1;
+   int arg = 1;
+   tipoEntrada entrada;    /* Fichero comprimido en memoria */
+   tipoIndice indice;      /* Posición y longitud de cada bloque */
+   tipoSalida proyeccion;  /* Fichero de salida proyectado en memoria */
+   int proyectada;
+   size_t primero, ultimo, siguiente;
+   uint64_t inicio, n;     /* Bytes originales que se piden */
+   atomic<int> error(0);   /* -1 o ERROR_DICCIONARIO si un bloque falla */
+   atomic<uint32_t> falta(0);  /* Diccionario que pide el bloque, con ERROR_DICCIONARIO */
+   FILE *fs;               /* Fichero de salida si no se puede proyectar */
+
+   /* Opciones */
+   while(arg + 1 < argc && argv[arg][0] == '-') {
+      if(!strcmp(argv[arg], "--stats")) {
+         estadisticas = 1;
+         arg++;
+         continue;
+      }
+      if(!strcmp(argv[arg], "-j")) hilos = atoi(argv[arg+1]);
+      else if(!strcmp(argv[arg], "-d")) {
+         if(LeerDiccionario(argv[arg+1], &diccionario) < 0) {
+            fprintf(stderr, "%s no es un diccionario válido\n", argv[arg+1]);
+            return 1;
+         }
+         estatico = &diccionario;
+      }
+      else if(!strcmp(argv[arg], "--range"))
+         rango = opcionValida = sscanf(argv[arg+1], "%llu:%llu", &desde, &cuantos) == 2;
+      else break;
+      arg += 2;
+   }
+   if(argc - arg < 2 || hilos < 1 || !opcionValida) {
+      fprintf(stderr, "Usar:\n%s [-j hilos] [-d diccionario] [--range inicio:longitud] [--stats] <fichero_entrada> <fichero_salida>\n",
+                     argv[0]);
+      fprintf(stderr, "  -j hilos                  bloques que se descomprimen en paralelo (por defecto %u)\n",
+                     parallel::default_workers());
+      fprintf(stderr, "  -d diccionario            el diccionario con el que se comprimió, si se usó\n");
+      fprintf(stderr, "  --range inicio:longitud   sólo esos bytes del fichero original\n");
+      fprintf(stderr, "  --stats                   tiempo de cada fase y contadores\n");
       return 1;
    }
 
-   vector<double> tiempos;
-   for (int iter = 0; iter < 20; ++iter) {
-      auto start =chrono::high_resolution_clock::now();
-
-      tipoNodo *Arbol;        /* Arbol de codificación */
-      long int Longitud;      /* Longitud de fichero */
-      int nElementos;         /* Elementos de árbol */
-      unsigned long int bits; /* Almacen de bits para decodificación */
-      FILE *fe, *fs;          /* Ficheros de entrada y salida */
+   /* La memoria de trabajo de cada hilo (las tablas de decodificación, una
+      por tabla que puede tener un bloque de orden 1, y el diccionario LZW),
+      reservada una sola vez: cada bloque la reutiliza sin pedir memoria */
+   vector<tipoDecodificador> decodificadores(hilos);
 
-      tipoNodo *p, *q;        /* Auxiliares */
-      unsigned char a;
-      int i, j;
+   /* Leer la cabecera y el índice de bloques */
+   {
+      stats::Timer t(stats::read);
+      if(AbrirEntrada(&entrada, argv[arg]) < 0) {
+         fprintf(stderr, "No se puede leer %s\n", argv[arg]);
+         return 1;
+      }
+      if(LeerIndice(entrada.datos, entrada.longitud, &indice) < 0) {
+         fprintf(stderr, "%s no es un fichero comprimido válido\n", argv[arg]);
+         return 1;
+      }
+   }
 
-      /* Crear un arbol con la información de la tabla */
-      Arbol = (tipoNodo *)malloc(sizeof(tipoNodo)); /* un nodo nuevo */
-      Arbol->letra = 0;
-      Arbol->uno = Arbol->cero = NULL;
-      fe = fopen(argv[1], "rb");
-      fread(&Longitud, sizeof(long int), 1, fe); /* Lee el número de caracteres */
-      fread(&nElementos, sizeof(int), 1, fe); /* Lee el número de elementos */
-      for(i = 0; i < nElementos; i++) /* Leer todos los elementos */
-      {
-         p = (tipoNodo *)malloc(sizeof(tipoNodo)); /* un nodo nuevo */
-         fread(&p->letra, sizeof(char), 1, fe); /* Lee el carácter */
-         fread(&p->bits, sizeof(unsigned long int), 1, fe); /* Lee el código */
-         fread(&p->nbits, sizeof(char), 1, fe); /* Lee la longitud */
-         p->cero = p->uno = NULL;
-         /* Insertar el nodo en su lugar */
-         j = 1 << (p->nbits-1);
-         q = Arbol;
-         while(j > 1) {
-            if(p->bits & j) /* es un uno*/
-               if(q->uno) q = q->uno;   /* Si el nodo existe, nos movemos a él */
-               else {                   /* Si no existe, lo creamos */
-                  q->uno = (tipoNodo *)malloc(sizeof(tipoNodo)); /* un nodo nuevo */
-                  q = q->uno;
-                  q->letra = 0;
-                  q->uno = q->cero = NULL;
-               }
-            else /* es un cero */
-               if(q->cero) q = q->cero; /* Si el nodo existe, nos movemos a él */
-               else {                   /* Si no existe, lo creamos */
-                  q->cero = (tipoNodo *)malloc(sizeof(tipoNodo)); /* un nodo nuevo */
-                  q = q->cero;
-                  q->letra = 0;
-                  q->uno = q->cero = NULL;
-               }
-            j >>= 1;  /* Siguiente bit */
-         }
-         /* Ultimo Bit */
-         if(p->bits & 1) /* es un uno*/
-            q->uno = p;
-         else            /* es un cero */
-            q->cero = p;
+   /* Rango pedido, recortado al final del fichero original */
+   inicio = 0;
+   n = indice.longitud;
+   if(rango) {
+      inicio = desde;
+      n = cuantos;
+      if(RecortarRango(&indice, inicio, &n) < 0) {
+         fprintf(stderr, "El inicio %llu está fuera de los %llu bytes originales\n",
+                        desde, (unsigned long long)indice.longitud);
+         return 1;
       }
-      /* Leer datos comprimidos y extraer al fichero de salida */
-      bits = 0;
-      fs = fopen(argv[2], "w");
-      /* Lee los primeros cuatro bytes en la doble palabra bits */
-      fread(&a, sizeof(char), 1, fe);
-      bits |= a;
-      bits <<= 8;
-      fread(&a, sizeof(char), 1, fe);
-      bits |= a;
-      bits <<= 8;
-      fread(&a, sizeof(char), 1, fe);
-      bits |= a;
-      bits <<= 8;
-      fread(&a, sizeof(char), 1, fe);
-      bits |= a;
-      j = 0; /* Cada 8 bits leemos otro byte */
-      q = Arbol;
-      /* Bucle */
-      do {
-         if(bits & 0x80000000) q = q->uno; else q = q->cero; /* Rama adecuada */
-         bits <<= 1;           /* Siguiente bit */
-         j++;
-         if(8 == j) {          /* Cada 8 bits */
-            i = fread(&a, sizeof(char), 1, fe); /* Leemos un byte desde el fichero */
-            bits |= a;                    /* Y lo insertamos en bits */
-            j = 0;                        /* No quedan huecos */
-         }
-         if(!q->uno && !q->cero) {        /* Si el nodo es una letra */
-            putc(q->letra, fs);           /* La escribimos en el fichero de salida */
-            Longitud--;                   /* Actualizamos longitud que queda */
-            q = Arbol;                    /* Volvemos a la raiz del árbol */
-         }
-      } while(Longitud);                  /* Hasta que acabe el fichero */
-      /* Procesar la cola */
+      AccesoAleatorio(&entrada);  /* Sólo se leen los bloques del rango */
+   }
+   BloquesDelRango(&indice, inicio, n, &primero, &ultimo);
 
-      fclose(fs);                         /* Cerramos ficheros */
-      fclose(fe);
+   /* Un hilo trae los bloques comprimidos del rango, el grupo de hilos
+      los descomprime y otro hilo escribe los resultados en orden. Al
+      copiar cada bloque comprimido en el hilo lector, las lecturas del
+      disco (los fallos de página de la proyección) no paran a los hilos
+      que descomprimen.
+      La longitud de la salida se conoce de antemano: si se puede crear el
+      fichero con ese tamaño y proyectarlo, cada hilo descomprime sus
+      bloques directamente en él y no queda nada por escribir. Si no
+      (tuberías, terminales...), el hilo escritor usa stdio. De los
+      bloques de los extremos sólo se guarda la parte pedida */
+   proyectada = CrearSalida(&proyeccion, argv[arg+1], n) == 0;
+   fs = NULL;
+   if(!proyectada && !(fs = fopen(argv[arg+1], "wb"))) {
+      fprintf(stderr, "No se puede crear %s\n", argv[arg+1]);
+      return 1;
+   }
+   siguiente = primero;
+   pipeline::run(hilos, 2 * hilos,
+      [&](pipeline::Block &c) {
+         stats::Timer t(stats::read);
+         if(siguiente == ultimo || error) return false;
+         const tipoBloque *b = &indice.bloques[siguiente++];
+         if(c.data.size() < b->tam) c.data.resize(b->tam);
+         c.size = b->tam;
+         memcpy(c.data.data(), entrada.datos + b->posicion, b->tam);
+         return true;
+      },
+      [&](unsigned hilo, pipeline::Block &c, pipeline::Block &d) {
+         const tipoBloque *b = &indice.bloques[primero + c.index];
+         uint64_t a, z;
+         uint8_t *destino;
+         int r;
 
-      BorrarArbol(Arbol);                 /* Borramos el árbol */
+         ParteDelBloque(b, inicio, n, &a, &z);
 
-      auto end =chrono::high_resolution_clock::now();
-      chrono::duration<double> elapsed = end - start;
-      tiempos.push_back(elapsed.count());
+         /* Un bloque entero del rango va en su sitio de la proyección */
+         if(proyectada && a == 0 && z == b->longitud) {
+            destino = proyeccion.datos + (b->inicio - inicio);
+            d.size = 0;
+         } else {
+            d.data.resize(b->longitud);
+            destino = (uint8_t *)d.data.data();
+            d.size = z - a;
+         }
+         r = DescomprimirBloqueAuto((const uint8_t *)c.data.data(), c.size, destino, b->longitud,
+                                    &decodificadores[hilo], estatico);
+         if(r < 0) {
+            if(r == ERROR_DICCIONARIO) falta = LeerU32((const uint8_t *)c.data.data() + 1);
+            error = r;
+            d.size = 0;
+         } else if(d.size && proyectada) {
+            memcpy(proyeccion.datos + (b->inicio + a - inicio), &d.data[a], d.size);
+            d.size = 0;
+         }
+      },
+      [&](pipeline::Block &d) {
+         uint64_t a, z;
 
-      // Imprimir el tiempo en la terminal
-      cout << "Iteracion " << iter + 1 << ": " << elapsed.count() << " segundos" << std::endl;
+         ParteDelBloque(&indice.bloques[primero + d.index], inicio, n, &a, &z);
+         stats::Timer t(stats::write);
+         if(d.size && !error) fwrite(&d.data[a], 1, d.size, fs);
+      });
+   {
+      stats::Timer t(stats::write);
+      if(proyectada ? CerrarSalida(&proyeccion) < 0 : fclose(fs) != 0) {
+         fprintf(stderr, "No se puede escribir %s\n", argv[arg+1]);
+         return 1;
+      }
    }
+   CerrarEntrada(&entrada);
 
-   // Calcular el promedio de los tiempos
-   double promedio = std::accumulate(tiempos.begin(), tiempos.end(), 0.0) / tiempos.size();
+   if(error == ERROR_DICCIONARIO) {
+      if(estatico)
+         fprintf(stderr, "%s se comprimió con el diccionario %08x, no con el %08x\n", argv[arg],
+                        (unsigned)falta, (unsigned)estatico->id);
+      else
+         fprintf(stderr, "%s se comprimió con el diccionario %08x: hay que pasarlo con -d\n", argv[arg],
+                        (unsigned)falta);
+      return 1;
+   }
+   if(error) {
+      fprintf(stderr, "%s está dañado\n", argv[arg]);
+      return 1;
+   }
 
-   // Escribir los tiempos y el promedio en el archivo CSV
-   ofstream file("tiemposDecodificar.csv");
-   for (const auto &tiempo : tiempos) {
-      file << tiempo << "\n";
+   /* Fases y contadores */
+   if(estadisticas) {
+      if(stats::enabled) stats::print(stderr, stats::collect());
+      else fprintf(stderr, "Las estadísticas necesitan compilar con -DCODEC_STATS\n");
    }
-   file << "Promedio: " << promedio << "\n";
-   file.close();
 
    return 0;
 }
-
-/* Función recursiva para borrar un arbol */
-void BorrarArbol(tipoNodo *n) {
-   if(n->cero) BorrarArbol(n->cero);
-   if(n->uno)  BorrarArbol(n->uno);
-   free(n);
-}
\ No newline at end of file
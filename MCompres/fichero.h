@@ -0,0 +1,156 @@
+#ifndef FICHERO_H
+#define FICHERO_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Tamaño de cada lectura cuando el fichero no se puede proyectar */
+#define TAM_LECTURA (1 << 20)
+
+/* Fichero de entrada completo en memoria */
+typedef struct _entrada {
+    const uint8_t *datos;   /* Contenido del fichero */
+    size_t longitud;        /* Número de bytes del fichero */
+    int proyectado;         /* 1 si datos viene de mmap, 0 si de malloc */
+} tipoEntrada;
+
+/* Fichero de salida de tamaño conocido, proyectado en memoria */
+typedef struct _salida {
+    uint8_t *datos;         /* Contenido del fichero */
+    size_t longitud;        /* Número de bytes del fichero */
+    int fd;                 /* Descriptor del fichero */
+} tipoSalida;
+
+/* Lee el resto de fd en bloques grandes sobre un buffer que va creciendo */
+static inline int LeerPorBloques(tipoEntrada *e, int fd) {
+    uint8_t *buffer = NULL, *nuevo;
+    size_t capacidad = 0, usado = 0;
+    ssize_t leidos;
+
+    do {
+        if(capacidad - usado < TAM_LECTURA) {
+            capacidad = capacidad ? capacidad * 2 : 4 * TAM_LECTURA;
+            nuevo = (uint8_t *)realloc(buffer, capacidad);
+            if(!nuevo) {
+                free(buffer);
+                return -1;
+            }
+            buffer = nuevo;
+        }
+        leidos = read(fd, buffer + usado, capacidad - usado);
+        if(leidos < 0) {
+            free(buffer);
+            return -1;
+        }
+        usado += leidos;
+    } while(leidos > 0);
+
+    e->datos = buffer;
+    e->longitud = usado;
+    e->proyectado = 0;
+    return 0;
+}
+
+/* Abre el fichero nombre y deja su contenido accesible en e->datos.
+   Intenta proyectarlo con mmap; si no es posible (tuberías, dispositivos...)
+   lo lee por bloques. Devuelve 0 si todo va bien y -1 en caso de error. */
+static inline int AbrirEntrada(tipoEntrada *e, const char *nombre) {
+    struct stat st;
+    void *p;
+    int fd, r;
+
+    e->datos = NULL;
+    e->longitud = 0;
+    e->proyectado = 0;
+
+    fd = open(nombre, O_RDONLY);
+    if(fd < 0) return -1;
+
+    if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        if(st.st_size == 0) {  /* mmap no admite longitud cero */
+            close(fd);
+            return 0;
+        }
+        p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(p != MAP_FAILED) {
+            madvise(p, st.st_size, MADV_SEQUENTIAL);
+            e->datos = (const uint8_t *)p;
+            e->longitud = st.st_size;
+            e->proyectado = 1;
+            close(fd);
+            return 0;
+        }
+    }
+
+    r = LeerPorBloques(e, fd);
+    close(fd);
+    return r;
+}
+
+/* Avisa de que la entrada se va a leer a saltos (por ejemplo, sólo algunos
+   bloques), para que el sistema no lea por adelantado lo que no se usa */
+static inline void AccesoAleatorio(tipoEntrada *e) {
+    if(e->proyectado) madvise((void *)e->datos, e->longitud, MADV_RANDOM);
+}
+
+/* Libera la memoria asociada a la entrada */
+static inline void CerrarEntrada(tipoEntrada *e) {
+    if(e->proyectado) munmap((void *)e->datos, e->longitud);
+    else free((void *)e->datos);
+    e->datos = NULL;
+    e->longitud = 0;
+    e->proyectado = 0;
+}
+
+/* Crea el fichero nombre con longitud bytes y lo proyecta en memoria para
+   escribir en él directamente. Devuelve -1 si no es posible (por ejemplo,
+   si no es un fichero regular); en ese caso hay que escribir con stdio */
+static inline int CrearSalida(tipoSalida *s, const char *nombre, size_t longitud) {
+    struct stat st;
+    void *p;
+
+    s->datos = NULL;
+    s->longitud = longitud;
+    s->fd = open(nombre, O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if(s->fd < 0) return -1;
+    if(fstat(s->fd, &st) < 0 || !S_ISREG(st.st_mode) || ftruncate(s->fd, longitud) < 0) {
+        close(s->fd);
+        return -1;
+    }
+#ifdef __linux__
+    /* Reservar el espacio ahora: si el disco se llenase al escribir en la
+       proyección, el proceso recibiría SIGBUS */
+    if(longitud && posix_fallocate(s->fd, 0, longitud) == ENOSPC) {
+        close(s->fd);
+        return -1;
+    }
+#endif
+    if(longitud == 0) return 0;  /* mmap no admite longitud cero */
+
+    p = mmap(NULL, longitud, PROT_READ | PROT_WRITE, MAP_SHARED, s->fd, 0);
+    if(p == MAP_FAILED) {
+        close(s->fd);
+        return -1;
+    }
+    s->datos = (uint8_t *)p;
+    return 0;
+}
+
+/* Termina de escribir la salida. Devuelve 0 o -1 si hay algún error */
+static inline int CerrarSalida(tipoSalida *s) {
+    int r = 0;
+
+    if(s->datos && munmap(s->datos, s->longitud) < 0) r = -1;
+    if(close(s->fd) < 0) r = -1;
+    s->datos = NULL;
+    s->fd = -1;
+    return r;
+}
+
+#endif
@@ -0,0 +1,1049 @@
+#ifndef HUFFMAN_H
+#define HUFFMAN_H
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "../common/stats.hpp"
+
+/* Alfabeto más grande que admiten las tablas. Los bytes sólo necesitan 256
+   símbolos, pero el modo híbrido de lzw codifica también los códigos LZW */
+#define MAX_SIMBOLOS 512
+
+/* Límites de la longitud de los códigos */
+#define MIN_BITS_HUFFMAN 8
+#define MAX_BITS_HUFFMAN 15
+#define BITS_HUFFMAN 11          /* Longitud máxima por defecto */
+
+/* Formato de fichero:
+     cabecera   "MCH", versión y tamaño de bloque
+     bloques    cada uno con su modo y sus datos (ver bloque.h); los bloques
+                Huffman llevan su tabla de longitudes y sus flujos
+     índice     posición en el fichero y longitud original de cada bloque
+     pie        posición del índice y número de bloques
+   La versión 3 sólo tenía bloques Huffman, que la 4 sigue leyendo */
+#define VERSION_FORMATO 4
+#define VERSION_MINIMA 3
+#define TAM_CABECERA 8           /* Firma (4) + Tamaño de bloque (4) */
+#define TAM_ENTRADA_INDICE 12    /* Posición (8) + Longitud original (4) */
+#define TAM_PIE 12               /* Posición del índice (8) + Número de bloques (4) */
+#define TAM_BLOQUE (1 << 20)     /* Bytes originales por bloque */
+
+/* En el modo de cuatro flujos el bloque lleva una tabla de saltos con el
+   tamaño en bytes de cada flujo */
+#define TAM_SALTOS 16
+
+/* Tamaño máximo de la tabla de longitudes para un alfabeto de n símbolos */
+#define TAM_MAX_TABLA(n) (((n) + 7) / 8 + ((n) + 1) / 2)
+
+/* Bytes que pueden hacer falta para codificar n símbolos, incluido el margen
+   que necesita el escritor de bits para volcar palabras completas */
+#define COTA_HUFFMAN(n) ((size_t)(n) * MAX_BITS_HUFFMAN / 8 + 16)
+#define COTA_HUFFMAN4(n) (COTA_HUFFMAN(n) + TAM_SALTOS + 4)
+
+/* Tablas de un bloque de orden 1 y bytes del mapa que asigna una tabla a
+   cada contexto, dos contextos por byte */
+#define MAX_TABLAS_CONTEXTO 16
+#define TAM_MAPA_CONTEXTOS 128
+
+/* Lo más que ocupa un bloque de cualquier modo: el de orden 1, con todas sus
+   tablas, es el que más puede crecer */
+#define COTA_BLOQUE(n) (2 + TAM_MAPA_CONTEXTOS + MAX_TABLAS_CONTEXTO * TAM_MAX_TABLA(256) + COTA_HUFFMAN4(n))
+
+/* Código de un símbolo */
+typedef struct _codigo {
+    uint16_t bits;          /* Valor del código */
+    uint8_t nbits;          /* Número de bits del código */
+} tipoCodigo;
+
+/* Bits que resuelve de una vez la tabla principal de decodificación; los
+   códigos más largos siguen en una subtabla */
+#define BITS_TABLA 11
+
+/* Entrada de la tabla de decodificación */
+typedef struct _entradaTabla {
+    uint16_t simbolo;       /* Símbolo, o inicio de la subtabla si nbits es 0 */
+    uint8_t nbits;          /* Longitud del código; 0 si remite a una subtabla */
+    uint8_t extra;          /* Bits que indexan la subtabla */
+} tipoEntradaTabla;
+
+/* Tabla principal de 2^BITS_TABLA entradas seguida de las subtablas, todas
+   en un array fijo que se reutiliza de un bloque a otro. Cada subtabla tiene
+   al menos un código largo, así que hay como mucho una por símbolo */
+#define ENTRADAS_DECODIFICACION ((1 << BITS_TABLA) + MAX_SIMBOLOS * (1 << (MAX_BITS_HUFFMAN - BITS_TABLA)))
+
+typedef struct _tablaDecodificacion {
+    tipoEntradaTabla entradas[ENTRADAS_DECODIFICACION];
+    unsigned int usadas;    /* Entradas ocupadas por la tabla actual */
+    int maxBits;            /* Longitud del código más largo */
+} tipoTablaDecodificacion;
+
+/* Lector de bits: mantiene los bits pendientes alineados a la izquierda en
+   una palabra de 64 bits y la rellena leyendo 8 bytes de golpe */
+typedef struct _lector {
+    uint64_t bits;          /* Bits pendientes, el siguiente en el bit 63 */
+    int nbits;              /* Número de bits pendientes */
+    const uint8_t *p;       /* Siguiente byte por leer; puede pasar de fin */
+    const uint8_t *inicio;  /* Comienzo del flujo */
+    const uint8_t *fin;     /* Final del flujo */
+} tipoLector;
+
+/* Entrada del índice de bloques */
+typedef struct _bloque {
+    uint64_t posicion;      /* Posición del bloque en el fichero comprimido */
+    uint64_t tam;           /* Bytes comprimidos del bloque */
+    uint64_t inicio;        /* Posición de sus datos en el fichero original */
+    uint32_t longitud;      /* Bytes originales del bloque */
+} tipoBloque;
+
+/* Índice de un fichero comprimido */
+typedef struct _indice {
+    std::vector<tipoBloque> bloques;
+    uint32_t tamBloque;     /* Tamaño de bloque con el que se comprimió */
+    uint64_t longitud;      /* Bytes originales en total */
+} tipoIndice;
+
+/* Memoria de trabajo de LongitudesHuffman. Quien calcula un código tras
+   otro guarda una y la pasa cada vez, y a partir del primero ya no se pide
+   memoria */
+typedef struct _paquetes {
+    std::vector<int> orden;                         /* Símbolos presentes */
+    std::vector<unsigned long int> peso, pesoPrevio;
+    std::vector<unsigned char> esHoja;              /* Por nivel, qué elementos son hojas */
+} tipoPaquetes;
+
+/* Escritor de bits: acumula los bits alineados a la izquierda en una palabra
+   de 64 bits y vuelca bytes completos en un buffer de memoria */
+typedef struct _escritor {
+    uint64_t acumulador;    /* Bits pendientes, el primero en el bit 63 */
+    int nbits;              /* Número de bits pendientes */
+    uint8_t *p;             /* Siguiente byte libre del buffer */
+} tipoEscritor;
+
+/* Enteros en little-endian, independientes de la plataforma */
+static inline void EscribirU32(uint8_t *p, uint32_t v) {
+    for(int i = 0; i < 4; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static inline uint32_t LeerU32(const uint8_t *p) {
+    return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline void EscribirU64(uint8_t *p, uint64_t v) {
+    for(int i = 0; i < 8; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static inline uint64_t LeerU64(const uint8_t *p) {
+    uint64_t v = 0;
+    for(int i = 7; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+/* Guarda una palabra de 64 bits en big-endian, el orden en que se leen los bits */
+static inline void EscribirU64BE(uint8_t *p, uint64_t v) {
+#if defined(__GNUC__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    v = __builtin_bswap64(v);
+    memcpy(p, &v, 8);
+#else
+    for(int i = 0; i < 8; i++) p[i] = (uint8_t)(v >> (56 - 8 * i));
+#endif
+}
+
+static inline uint64_t LeerU64BE(const uint8_t *p) {
+#if defined(__GNUC__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return __builtin_bswap64(v);
+#else
+    uint64_t v = 0;
+    for(int i = 0; i < 8; i++) v = (v << 8) | p[i];
+    return v;
+#endif
+}
+
+/* Cabecera de fichero: firma, versión y tamaño de bloque */
+static inline void EscribirCabecera(uint8_t *p, uint32_t tamBloque) {
+    p[0] = 'M';
+    p[1] = 'C';
+    p[2] = 'H';
+    p[3] = VERSION_FORMATO;
+    EscribirU32(p + 4, tamBloque);
+}
+
+static inline int LeerCabecera(const uint8_t *p, uint32_t *tamBloque) {
+    if(p[0] != 'M' || p[1] != 'C' || p[2] != 'H' || p[3] < VERSION_MINIMA || p[3] > VERSION_FORMATO) return -1;
+    *tamBloque = LeerU32(p + 4);
+    return *tamBloque ? 0 : -1;
+}
+
+/* Cuenta las apariciones de cada byte. Se usan cuatro histogramas parciales
+   intercalados para que bytes consecutivos iguales no dependan del mismo
+   contador; al final se suman */
+static inline void Cuenta(const uint8_t *datos, size_t longitud, unsigned long int frecuencia[256]) {
+    unsigned long int parcial[4][256];
+    size_t i;
+    int c;
+
+    memset(parcial, 0, sizeof(parcial));
+    for(i = 0; i + 4 <= longitud; i += 4) {
+        parcial[0][datos[i]]++;
+        parcial[1][datos[i+1]]++;
+        parcial[2][datos[i+2]]++;
+        parcial[3][datos[i+3]]++;
+    }
+    for(; i < longitud; i++) parcial[0][datos[i]]++;
+
+    for(c = 0; c < 256; c++)
+        frecuencia[c] = parcial[0][c] + parcial[1][c] + parcial[2][c] + parcial[3][c];
+}
+
+/* Calcula longitudes de código óptimas limitadas a maxBits con el algoritmo
+   package-merge. longitud[s] queda a 0 para los símbolos que no aparecen; si
+   sólo aparece uno, recibe longitud 1. memoria se reutiliza de una llamada a
+   otra. Devuelve la longitud más larga usada o -1 si maxBits no basta para
+   tantos símbolos */
+static inline int LongitudesHuffman(const unsigned long int *frecuencia, int nSimbolos,
+                                    int maxBits, unsigned char *longitud, tipoPaquetes *memoria) {
+    std::vector<int> &orden = memoria->orden;
+    int n, i, j, k, nivel, nPrevio, nActual, hojas, paquetes, maximo;
+
+    memset(longitud, 0, nSimbolos);
+    orden.clear();
+    for(i = 0; i < nSimbolos; i++)
+        if(frecuencia[i]) orden.push_back(i);
+    n = orden.size();
+    if(n == 0) return 0;
+    if(n == 1) {
+        longitud[orden[0]] = 1;
+        return 1;
+    }
+    if(maxBits < 1 || maxBits > MAX_BITS_HUFFMAN || (1 << maxBits) < n) return -1;
+
+    /* Hojas de menor a mayor frecuencia; a igualdad, por símbolo */
+    for(i = 1; i < n; i++) {
+        int s = orden[i];
+        for(j = i; j > 0 && frecuencia[orden[j-1]] > frecuencia[s]; j--) orden[j] = orden[j-1];
+        orden[j] = s;
+    }
+
+    /* Cada nivel es la mezcla ordenada de las hojas con los paquetes (pares
+       consecutivos) del nivel inferior. Para reconstruir las longitudes basta
+       saber qué elementos de cada nivel son hojas. Cada elemento que se lee
+       se ha escrito antes, así que no hace falta borrar lo que quede de la
+       llamada anterior */
+    std::vector<unsigned long int> &peso = memoria->peso, &pesoPrevio = memoria->pesoPrevio;
+    std::vector<unsigned char> &esHoja = memoria->esHoja;
+
+    if(peso.size() < (size_t)2 * n) {
+        peso.resize(2 * n);
+        pesoPrevio.resize(2 * n);
+    }
+    if(esHoja.size() < (size_t)maxBits * 2 * n) esHoja.resize((size_t)maxBits * 2 * n);
+
+    for(i = 0; i < n; i++) {
+        pesoPrevio[i] = frecuencia[orden[i]];
+        esHoja[(size_t)(maxBits - 1) * 2 * n + i] = 1;
+    }
+    nPrevio = n;
+    for(nivel = maxBits - 2; nivel >= 0; nivel--) {
+        unsigned char *hoja = &esHoja[(size_t)nivel * 2 * n];
+        int p = 0, h = 0, np = nPrevio / 2;
+
+        nActual = 0;
+        while(h < n || p < np) {
+            if(p >= np || (h < n && frecuencia[orden[h]] <= pesoPrevio[2*p] + pesoPrevio[2*p+1])) {
+                peso[nActual] = frecuencia[orden[h++]];
+                hoja[nActual++] = 1;
+            } else {
+                peso[nActual] = pesoPrevio[2*p] + pesoPrevio[2*p+1];
+                p++;
+                hoja[nActual++] = 0;
+            }
+        }
+        peso.swap(pesoPrevio);
+        nPrevio = nActual;
+    }
+
+    /* Se eligen los 2n-2 primeros elementos del nivel superior; cada paquete
+       elegido arrastra dos elementos del nivel siguiente. Las hojas elegidas
+       en un nivel son siempre las de menor frecuencia */
+    k = 2 * n - 2;
+    for(nivel = 0; nivel < maxBits && k > 0; nivel++) {
+        const unsigned char *hoja = &esHoja[(size_t)nivel * 2 * n];
+
+        hojas = 0;
+        for(i = 0; i < k; i++) hojas += hoja[i];
+        for(i = 0; i < hojas; i++) longitud[orden[i]]++;
+        paquetes = k - hojas;
+        k = 2 * paquetes;
+    }
+
+    maximo = 0;
+    for(i = 0; i < n; i++)
+        if(longitud[orden[i]] > maximo) maximo = longitud[orden[i]];
+    return maximo;
+}
+
+/* Asigna códigos canónicos: dentro de cada longitud, en orden de símbolo */
+static inline void CodigosCanonicos(const unsigned char *longitud, int nSimbolos, unsigned int *codigo) {
+    unsigned int cuenta[MAX_BITS_HUFFMAN + 1], siguiente[MAX_BITS_HUFFMAN + 1];
+    unsigned int c = 0;
+    int i, bits;
+
+    memset(cuenta, 0, sizeof(cuenta));
+    for(i = 0; i < nSimbolos; i++) cuenta[longitud[i]]++;
+    cuenta[0] = 0;
+    for(bits = 1; bits <= MAX_BITS_HUFFMAN; bits++) {
+        c = (c + cuenta[bits-1]) << 1;
+        siguiente[bits] = c;
+    }
+    for(i = 0; i < nSimbolos; i++)
+        codigo[i] = longitud[i] ? siguiente[longitud[i]]++ : 0;
+}
+
+/* Tabla de codificación directa, indexada por símbolo */
+static inline void CrearTablaCodigos(const unsigned char *longitud, int nSimbolos, tipoCodigo *tabla) {
+    unsigned int codigo[MAX_SIMBOLOS];
+    int i;
+
+    CodigosCanonicos(longitud, nSimbolos, codigo);
+    for(i = 0; i < nSimbolos; i++) {
+        tabla[i].bits = codigo[i];
+        tabla[i].nbits = longitud[i];
+    }
+}
+
+static inline void IniciarEscritor(tipoEscritor *e, uint8_t *buffer) {
+    e->acumulador = 0;
+    e->nbits = 0;
+    e->p = buffer;
+}
+
+/* Añade n bits; el llamador garantiza que caben en el acumulador */
+static inline void PonerBits(tipoEscritor *e, uint32_t bits, int n) {
+    e->acumulador |= (uint64_t)bits << (64 - e->nbits - n);
+    e->nbits += n;
+}
+
+/* Vuelca los bytes completos. Escribe siempre 8 bytes, aunque sólo avanza
+   los que están completos, así que el buffer necesita ese margen */
+static inline void VaciarBits(tipoEscritor *e) {
+    EscribirU64BE(e->p, e->acumulador);
+    e->p += e->nbits >> 3;
+    e->acumulador <<= e->nbits & ~7;
+    e->nbits &= 7;
+}
+
+/* Vuelca también el último byte incompleto, rellenado con ceros */
+static inline void TerminarBits(tipoEscritor *e) {
+    VaciarBits(e);
+    if(e->nbits) e->p++;
+    e->acumulador = 0;
+    e->nbits = 0;
+}
+
+/* Codifica n símbolos. Tras cada volcado quedan como mucho 7 bits pendientes,
+   así que caben cuatro códigos de hasta 14 bits o tres de 15 antes del
+   siguiente. El buffer del escritor necesita COTA_HUFFMAN(n) bytes libres */
+static inline void CodificarHuffman(tipoEscritor *e, const uint8_t *src, size_t n,
+                                    const tipoCodigo *tabla, int maxBits) {
+    const uint8_t *fin = src + n;
+
+    VaciarBits(e);
+    if(maxBits <= 14) {
+        for(; fin - src >= 4; src += 4) {
+            PonerBits(e, tabla[src[0]].bits, tabla[src[0]].nbits);
+            PonerBits(e, tabla[src[1]].bits, tabla[src[1]].nbits);
+            PonerBits(e, tabla[src[2]].bits, tabla[src[2]].nbits);
+            PonerBits(e, tabla[src[3]].bits, tabla[src[3]].nbits);
+            VaciarBits(e);
+        }
+    } else {
+        for(; fin - src >= 3; src += 3) {
+            PonerBits(e, tabla[src[0]].bits, tabla[src[0]].nbits);
+            PonerBits(e, tabla[src[1]].bits, tabla[src[1]].nbits);
+            PonerBits(e, tabla[src[2]].bits, tabla[src[2]].nbits);
+            VaciarBits(e);
+        }
+    }
+    for(; src < fin; src++) {
+        PonerBits(e, tabla[*src].bits, tabla[*src].nbits);
+        VaciarBits(e);
+    }
+}
+
+/* Crea la tabla de decodificación sobre su array fijo, sin pedir memoria.
+   Cada código de hasta BITS_TABLA bits ocupa todas las entradas principales
+   que empiezan por él. Los códigos más largos comparten una subtabla por
+   cada prefijo de BITS_TABLA bits; en orden canónico los de un mismo prefijo
+   van seguidos, así que basta con comparar con el prefijo anterior */
+static inline void CrearTablaDecodificacion(const unsigned char *longitud, int nSimbolos,
+                                            tipoTablaDecodificacion *t) {
+    unsigned int codigo[MAX_SIMBOLOS];
+    unsigned long int kraft = 0;
+    tipoEntradaTabla *e = t->entradas;
+    unsigned int i, primero, cuantos, prefijo, anterior;
+    int s, bits, extra;
+
+    CodigosCanonicos(longitud, nSimbolos, codigo);
+    t->maxBits = 0;
+    for(s = 0; s < nSimbolos; s++) {
+        if(longitud[s] > t->maxBits) t->maxBits = longitud[s];
+        if(longitud[s]) kraft += 1UL << (MAX_BITS_HUFFMAN - longitud[s]);
+    }
+    extra = t->maxBits > BITS_TABLA ? t->maxBits - BITS_TABLA : 0;
+    t->usadas = 1 << BITS_TABLA;
+
+    /* Si el código no es completo (sólo ocurre con un único símbolo), las
+       entradas sobrantes consumen un bit para no atascar al decodificador */
+    if(kraft != 1UL << MAX_BITS_HUFFMAN)
+        for(i = 0; i < t->usadas; i++) t->entradas[i] = tipoEntradaTabla{0, 1, 0};
+
+    for(s = 0; s < nSimbolos; s++) {
+        if(!longitud[s] || longitud[s] > BITS_TABLA) continue;
+        primero = codigo[s] << (BITS_TABLA - longitud[s]);
+        cuantos = 1 << (BITS_TABLA - longitud[s]);
+        for(i = 0; i < cuantos; i++)
+            t->entradas[primero + i] = tipoEntradaTabla{(uint16_t)s, longitud[s], 0};
+    }
+
+    anterior = 1 << BITS_TABLA;
+    for(bits = BITS_TABLA + 1; bits <= t->maxBits; bits++) {
+        for(s = 0; s < nSimbolos; s++) {
+            if(longitud[s] != bits) continue;
+            prefijo = codigo[s] >> (bits - BITS_TABLA);
+            if(prefijo != anterior) {  /* Nueva subtabla al final de las usadas */
+                t->entradas[prefijo] = tipoEntradaTabla{(uint16_t)t->usadas, 0, (uint8_t)extra};
+                e = t->entradas + t->usadas;
+                t->usadas += 1 << extra;
+                anterior = prefijo;
+            }
+            primero = (codigo[s] & ((1 << (bits - BITS_TABLA)) - 1)) << (t->maxBits - bits);
+            cuantos = 1 << (t->maxBits - bits);
+            for(i = 0; i < cuantos; i++)
+                e[primero + i] = tipoEntradaTabla{(uint16_t)s, (uint8_t)bits, 0};
+        }
+    }
+}
+
+static inline void IniciarLector(tipoLector *l, const uint8_t *inicio, const uint8_t *fin) {
+    l->bits = 0;
+    l->nbits = 0;
+    l->p = l->inicio = inicio;
+    l->fin = fin;
+}
+
+/* Rellena la palabra hasta tener al menos 56 bits. Los bytes que hubiera
+   tras el final del flujo se leen como ceros */
+static inline void RecargarBits(tipoLector *l) {
+    uint8_t resto[8];
+    uint64_t v;
+    int n;
+
+    if(l->fin - l->p >= 8) v = LeerU64BE(l->p);
+    else {
+        memset(resto, 0, sizeof(resto));
+        if(l->p < l->fin) memcpy(resto, l->p, l->fin - l->p);
+        v = LeerU64BE(resto);
+    }
+    l->bits |= v >> l->nbits;
+    n = (63 - l->nbits) >> 3;
+    l->p += n;
+    l->nbits += 8 * n;
+}
+
+/* Resuelve un símbolo con una consulta a la tabla principal y, para los
+   códigos largos, otra a su subtabla. Necesita maxBits bits pendientes */
+static inline unsigned int DecodificarSimbolo(tipoLector *l, const tipoEntradaTabla *t) {
+    tipoEntradaTabla e = t[l->bits >> (64 - BITS_TABLA)];
+
+    if(!e.nbits) e = t[e.simbolo + ((l->bits << BITS_TABLA) >> (64 - e.extra))];
+    l->bits <<= e.nbits;
+    l->nbits -= e.nbits;
+    return e.simbolo;
+}
+
+/* Decodifica n bytes en dst. Tras cada recarga hay al menos 56 bits, que
+   alcanzan para cuatro códigos de hasta 14 bits o tres de 15 */
+static inline void DecodificarHuffman(tipoLector *l, uint8_t *dst, size_t n,
+                                      const tipoTablaDecodificacion *t) {
+    const tipoEntradaTabla *e = t->entradas;
+    uint8_t *fin = dst + n;
+
+    if(t->maxBits <= 14) {
+        for(; fin - dst >= 4; dst += 4) {
+            RecargarBits(l);
+            dst[0] = DecodificarSimbolo(l, e);
+            dst[1] = DecodificarSimbolo(l, e);
+            dst[2] = DecodificarSimbolo(l, e);
+            dst[3] = DecodificarSimbolo(l, e);
+        }
+    } else {
+        for(; fin - dst >= 3; dst += 3) {
+            RecargarBits(l);
+            dst[0] = DecodificarSimbolo(l, e);
+            dst[1] = DecodificarSimbolo(l, e);
+            dst[2] = DecodificarSimbolo(l, e);
+        }
+    }
+    for(; dst < fin; dst++) {
+        RecargarBits(l);
+        *dst = DecodificarSimbolo(l, e);
+    }
+}
+
+/* Indica si se han consumido más bits de los que tenía el flujo */
+static inline int LectorAgotado(const tipoLector *l) {
+    return (l->p - l->inicio) * 8 - l->nbits > (l->fin - l->inicio) * 8;
+}
+
+/* Reparto de n símbolos en cuatro flujos consecutivos: los tres primeros de
+   (n+3)/4 símbolos y el último con el resto */
+static inline void RepartirFlujos(size_t n, size_t longitud[4]) {
+    size_t q = (n + 3) / 4, resto = n;
+
+    for(int k = 0; k < 4; k++) {
+        longitud[k] = resto < q ? resto : q;
+        resto -= longitud[k];
+    }
+}
+
+/* Codifica n símbolos como cuatro flujos de bits independientes precedidos
+   de su tabla de saltos. dst necesita COTA_HUFFMAN4(n) bytes. Devuelve los
+   bytes escritos */
+static inline size_t CodificarHuffman4(const uint8_t *src, size_t n, const tipoCodigo *tabla,
+                                       int maxBits, uint8_t *dst) {
+    tipoEscritor e;
+    size_t longitud[4];
+    uint8_t *p = dst + TAM_SALTOS;
+
+    RepartirFlujos(n, longitud);
+    for(int k = 0; k < 4; k++) {
+        IniciarEscritor(&e, p);
+        CodificarHuffman(&e, src, longitud[k], tabla, maxBits);
+        TerminarBits(&e);
+        EscribirU32(dst + 4 * k, e.p - p);
+        src += longitud[k];
+        p = e.p;
+    }
+    return p - dst;
+}
+
+/* Tamaño de un tramo de cuatro flujos según su tabla de saltos, o 0 si
+   supera los bytes disponibles */
+static inline size_t TamFlujos4(const uint8_t *src, size_t disponible) {
+    size_t total = TAM_SALTOS;
+
+    if(disponible < TAM_SALTOS) return 0;
+    for(int k = 0; k < 4; k++) total += LeerU32(src + 4 * k);
+    return total <= disponible ? total : 0;
+}
+
+/* Decodifica n bytes escritos con CodificarHuffman4. Los cuatro flujos se
+   decodifican entrelazados para que sus cadenas de dependencias se solapen.
+   Devuelve 0, o -1 si algún flujo está truncado */
+static inline int DecodificarHuffman4(const uint8_t *src, size_t tam, uint8_t *dst, size_t n,
+                                      const tipoTablaDecodificacion *t) {
+    const tipoEntradaTabla *e = t->entradas;
+    tipoLector l[4];
+    size_t longitud[4], comun, i;
+    const uint8_t *p = src + TAM_SALTOS;
+    uint8_t *d[4];
+    int k;
+
+    if(TamFlujos4(src, tam) == 0) return -1;
+    RepartirFlujos(n, longitud);
+    for(k = 0; k < 4; k++) {
+        IniciarLector(&l[k], p, p + LeerU32(src + 4 * k));
+        p += LeerU32(src + 4 * k);
+        d[k] = dst;
+        dst += longitud[k];
+    }
+
+    /* El último flujo es el más corto: hasta ahí avanzan los cuatro juntos,
+       dos símbolos de cada uno por recarga */
+    comun = longitud[3];
+    for(i = 0; i + 2 <= comun; i += 2) {
+        RecargarBits(&l[0]); RecargarBits(&l[1]); RecargarBits(&l[2]); RecargarBits(&l[3]);
+        d[0][i] = DecodificarSimbolo(&l[0], e);
+        d[1][i] = DecodificarSimbolo(&l[1], e);
+        d[2][i] = DecodificarSimbolo(&l[2], e);
+        d[3][i] = DecodificarSimbolo(&l[3], e);
+        d[0][i+1] = DecodificarSimbolo(&l[0], e);
+        d[1][i+1] = DecodificarSimbolo(&l[1], e);
+        d[2][i+1] = DecodificarSimbolo(&l[2], e);
+        d[3][i+1] = DecodificarSimbolo(&l[3], e);
+    }
+    if(i < comun) {
+        RecargarBits(&l[0]); RecargarBits(&l[1]); RecargarBits(&l[2]); RecargarBits(&l[3]);
+        d[0][i] = DecodificarSimbolo(&l[0], e);
+        d[1][i] = DecodificarSimbolo(&l[1], e);
+        d[2][i] = DecodificarSimbolo(&l[2], e);
+        d[3][i] = DecodificarSimbolo(&l[3], e);
+    }
+    for(k = 0; k < 4; k++) {
+        DecodificarHuffman(&l[k], d[k] + comun, longitud[k] - comun, t);
+        if(LectorAgotado(&l[k])) return -1;
+    }
+    return 0;
+}
+
+/* Huffman de orden 1: el contexto de cada byte es el byte anterior (0 para
+   el primero del bloque) y cada contexto usa una de hasta
+   MAX_TABLAS_CONTEXTO tablas. Agrupar los contextos parecidos en pocas
+   tablas aprovecha casi todo lo que aporta el byte anterior sin pagar 256
+   tablas de longitudes por bloque */
+
+/* Cuenta los pares de bytes: cuenta[256 * anterior + byte] */
+static inline void CuentaContextos(const uint8_t *datos, size_t longitud, uint32_t *cuenta) {
+    unsigned int anterior = 0;
+    size_t i;
+
+    memset(cuenta, 0, 256 * 256 * sizeof(uint32_t));
+    for(i = 0; i < longitud; i++) {
+        cuenta[256 * anterior + datos[i]]++;
+        anterior = datos[i];
+    }
+}
+
+/* Bits por aparición de cada símbolo con la tabla k, de esas frecuencias,
+   en coste[símbolo][k]. A los que no aparecen se les da media aparición,
+   para que un contexto que los usa no parezca gratis */
+static inline void ModeloTabla(const unsigned long int frecuencia[256], int k,
+                               float coste[256][MAX_TABLAS_CONTEXTO]) {
+    unsigned long int total = 0;
+    double base;
+    int s;
+
+    for(s = 0; s < 256; s++) total += frecuencia[s];
+    base = log2(total + 128.0);
+    for(s = 0; s < 256; s++) coste[s][k] = base - log2(frecuencia[s] + 0.5);
+}
+
+/* Bits que costaría el contexto con cada tabla. simbolos lista los
+   nSimbolos bytes que aparecen en él. Se calculan siempre todas las tablas,
+   porque así el bucle interior es de longitud fija y se vectoriza */
+static inline void BitsContexto(const uint32_t *cuenta, const uint8_t *simbolos, size_t nSimbolos,
+                                const float coste[256][MAX_TABLAS_CONTEXTO], float bits[MAX_TABLAS_CONTEXTO]) {
+    float suma[MAX_TABLAS_CONTEXTO];
+    int k;
+
+    for(k = 0; k < MAX_TABLAS_CONTEXTO; k++) suma[k] = 0;
+    for(size_t i = 0; i < nSimbolos; i++) {
+        const float *c = coste[simbolos[i]];
+        float n = cuenta[simbolos[i]];
+        for(k = 0; k < MAX_TABLAS_CONTEXTO; k++) suma[k] += n * c[k];
+    }
+    for(k = 0; k < MAX_TABLAS_CONTEXTO; k++) bits[k] = suma[k];
+}
+
+/* Reparte los 256 contextos entre como mucho maxTablas tablas con k-medias:
+   cada contexto va a la tabla con la que menos bits costaría y cada tabla se
+   recalcula con la suma de sus contextos, hasta que ninguno cambia de tabla.
+   La primera semilla es el contexto más frecuente y las siguientes, el que
+   peor se codifica con las tablas que ya hay, mientras lo que ahorraría con
+   su propia tabla pague lo que ocupa. Rellena mapa (0 para los contextos que
+   no aparecen) y las frecuencias de cada tabla. presentes es memoria de
+   trabajo que se reutiliza de un bloque a otro. Devuelve el número de tablas */
+static inline int AgruparContextos(const uint32_t *cuenta, int maxTablas, uint8_t mapa[256],
+                                   unsigned long int frecuencia[][256], std::vector<uint8_t> *presentes) {
+    std::vector<uint8_t> &simbolos = *presentes;
+    float coste[256][MAX_TABLAS_CONTEXTO], bits[MAX_TABLAS_CONTEXTO], logaritmo[256];
+    size_t desde[257];
+    double mejor[256], propio[256], nueva, ganancia;
+    unsigned long int total[256], n;
+    int usada[MAX_TABLAS_CONTEXTO];
+    int nTablas, c, s, k, elegido, iter, cambios;
+
+    simbolos.clear();
+    for(c = 0; c < 256; c++) {
+        desde[c] = simbolos.size();
+        total[c] = 0;
+        for(s = 0; s < 256; s++) {
+            if(!cuenta[256 * c + s]) continue;
+            simbolos.push_back(s);
+            total[c] += cuenta[256 * c + s];
+        }
+    }
+    desde[256] = simbolos.size();
+    memset(mapa, 0, 256);
+    memset(coste, 0, sizeof(coste));
+    if(simbolos.empty()) {
+        memset(frecuencia[0], 0, sizeof(frecuencia[0]));
+        return 1;
+    }
+
+    /* Una tabla propia ahorra la diferencia entre lo que cuesta el contexto
+       con las tablas que ya hay y lo que costaría con la suya. Casi todas
+       las cuentas son pequeñas, así que sus logaritmos salen de una tabla */
+    for(s = 0; s < 256; s++) logaritmo[s] = log2(s + 0.5);
+    elegido = 0;
+    for(c = 0; c < 256; c++) {
+        mejor[c] = 0;
+        propio[c] = total[c] * log2(total[c] + 128.0);
+        for(size_t i = desde[c]; i < desde[c+1]; i++) {
+            n = cuenta[256 * c + simbolos[i]];
+            propio[c] -= n * (n < 256 ? logaritmo[n] : log2(n + 0.5));
+        }
+        if(total[c] > total[elegido]) elegido = c;
+    }
+    for(nTablas = 0; nTablas < maxTablas; nTablas++) {
+        for(s = 0; s < 256; s++) frecuencia[nTablas][s] = cuenta[256 * elegido + s];
+        ModeloTabla(frecuencia[nTablas], nTablas, coste);
+
+        /* Sólo hace falta el coste con la tabla nueva */
+        elegido = -1;
+        ganancia = 8.0 * TAM_MAX_TABLA(256);
+        for(c = 0; c < 256; c++) {
+            if(!total[c]) continue;
+            nueva = 0;
+            for(size_t i = desde[c]; i < desde[c+1]; i++)
+                nueva += cuenta[256 * c + simbolos[i]] * coste[simbolos[i]][nTablas];
+            if(nTablas == 0 || nueva < mejor[c]) mejor[c] = nueva;
+            if(mejor[c] - propio[c] > ganancia) {
+                ganancia = mejor[c] - propio[c];
+                elegido = c;
+            }
+        }
+        if(elegido < 0) {
+            nTablas++;
+            break;
+        }
+    }
+
+    for(iter = 0; iter < 16; iter++) {
+        /* Cada contexto a su mejor tabla */
+        cambios = 0;
+        for(c = 0; c < 256; c++) {
+            if(!total[c]) continue;
+            BitsContexto(cuenta + 256 * c, &simbolos[desde[c]], desde[c+1] - desde[c], coste, bits);
+            elegido = 0;
+            for(k = 1; k < nTablas; k++)
+                if(bits[k] < bits[elegido]) elegido = k;
+            cambios += iter == 0 || mapa[c] != elegido;
+            mapa[c] = elegido;
+        }
+
+        /* Las tablas que se han quedado sin contextos desaparecen */
+        memset(usada, 0, sizeof(usada));
+        for(c = 0; c < 256; c++) usada[mapa[c]] |= total[c] != 0;
+        for(k = 0, s = 0; k < nTablas; k++) usada[k] = usada[k] ? s++ : -1;
+        nTablas = s;
+        for(c = 0; c < 256; c++) mapa[c] = total[c] ? usada[mapa[c]] : 0;
+
+        memset(frecuencia, 0, nTablas * sizeof(frecuencia[0]));
+        for(c = 0; c < 256; c++)
+            for(size_t i = desde[c]; i < desde[c+1]; i++)
+                frecuencia[mapa[c]][simbolos[i]] += cuenta[256 * c + simbolos[i]];
+        if(!cambios) break;
+        for(k = 0; k < nTablas; k++) ModeloTabla(frecuencia[k], k, coste);
+    }
+    return nTablas;
+}
+
+/* Codifica n bytes con la tabla de su contexto: tablas[c] es la del byte
+   anterior c. Como CodificarHuffman, vuelca cada cuatro códigos si ninguno
+   pasa de 14 bits y cada tres si no */
+static inline void CodificarContexto(tipoEscritor *e, const uint8_t *src, size_t n,
+                                     const tipoCodigo *const tablas[256], int maxBits) {
+    const uint8_t *fin = src + n;
+    unsigned int c = 0;
+
+    VaciarBits(e);
+    if(maxBits <= 14) {
+        for(; fin - src >= 4; src += 4) {
+            PonerBits(e, tablas[c][src[0]].bits, tablas[c][src[0]].nbits);
+            PonerBits(e, tablas[src[0]][src[1]].bits, tablas[src[0]][src[1]].nbits);
+            PonerBits(e, tablas[src[1]][src[2]].bits, tablas[src[1]][src[2]].nbits);
+            PonerBits(e, tablas[src[2]][src[3]].bits, tablas[src[2]][src[3]].nbits);
+            c = src[3];
+            VaciarBits(e);
+        }
+    } else {
+        for(; fin - src >= 3; src += 3) {
+            PonerBits(e, tablas[c][src[0]].bits, tablas[c][src[0]].nbits);
+            PonerBits(e, tablas[src[0]][src[1]].bits, tablas[src[0]][src[1]].nbits);
+            PonerBits(e, tablas[src[1]][src[2]].bits, tablas[src[1]][src[2]].nbits);
+            c = src[2];
+            VaciarBits(e);
+        }
+    }
+    for(; src < fin; src++) {
+        PonerBits(e, tablas[c][*src].bits, tablas[c][*src].nbits);
+        c = *src;
+        VaciarBits(e);
+    }
+}
+
+/* Decodifica n bytes escritos con CodificarContexto; tablas[c] son las
+   entradas de la tabla del contexto c. Cada símbolo elige la tabla del
+   siguiente, así que no se pueden solapar como en DecodificarHuffman4 */
+static inline void DecodificarContexto(tipoLector *l, uint8_t *dst, size_t n,
+                                       const tipoEntradaTabla *const tablas[256], int maxBits) {
+    uint8_t *fin = dst + n;
+    unsigned int c = 0;
+
+    if(maxBits <= 14) {
+        for(; fin - dst >= 4; dst += 4) {
+            RecargarBits(l);
+            dst[0] = c = DecodificarSimbolo(l, tablas[c]);
+            dst[1] = c = DecodificarSimbolo(l, tablas[c]);
+            dst[2] = c = DecodificarSimbolo(l, tablas[c]);
+            dst[3] = c = DecodificarSimbolo(l, tablas[c]);
+        }
+    } else {
+        for(; fin - dst >= 3; dst += 3) {
+            RecargarBits(l);
+            dst[0] = c = DecodificarSimbolo(l, tablas[c]);
+            dst[1] = c = DecodificarSimbolo(l, tablas[c]);
+            dst[2] = c = DecodificarSimbolo(l, tablas[c]);
+        }
+    }
+    for(; dst < fin; dst++) {
+        RecargarBits(l);
+        *dst = c = DecodificarSimbolo(l, tablas[c]);
+    }
+}
+
+/* Escribe la tabla compacta: un mapa de bits con los símbolos presentes y
+   sus longitudes, dos por byte. Devuelve los bytes escritos */
+static inline size_t EscribirLongitudes(uint8_t *dst, const unsigned char *longitud, int nSimbolos) {
+    size_t nMapa = (nSimbolos + 7) / 8, pos;
+    int i, n = 0;
+
+    memset(dst, 0, nMapa);
+    pos = nMapa;
+    for(i = 0; i < nSimbolos; i++) {
+        if(!longitud[i]) continue;
+        dst[i / 8] |= 1 << (i % 8);
+        if(n % 2 == 0) dst[pos] = longitud[i];
+        else dst[pos++] |= longitud[i] << 4;
+        n++;
+    }
+    return pos + n % 2;
+}
+
+/* Lee una tabla escrita con EscribirLongitudes y comprueba que describe un
+   código prefijo completo. Devuelve los bytes consumidos o -1 si es inválida */
+static inline long LeerLongitudes(const uint8_t *src, size_t disponible,
+                                  unsigned char *longitud, int nSimbolos) {
+    size_t nMapa = (nSimbolos + 7) / 8, pos = nMapa;
+    unsigned long int kraft = 0;
+    int i, n = 0;
+
+    if(disponible < nMapa) return -1;
+    for(i = 0; i < nSimbolos; i++) {
+        longitud[i] = 0;
+        if(!(src[i / 8] & (1 << (i % 8)))) continue;
+        if(pos >= disponible) return -1;
+        if(n % 2 == 0) longitud[i] = src[pos] & 0x0F;
+        else longitud[i] = src[pos++] >> 4;
+        if(!longitud[i]) return -1;
+        kraft += 1UL << (MAX_BITS_HUFFMAN - longitud[i]);
+        n++;
+    }
+    /* Un único símbolo usa un código de un bit y deja la mitad libre */
+    if(n > 1 && kraft != 1UL << MAX_BITS_HUFFMAN) return -1;
+    return pos + n % 2;
+}
+
+/* Tamaño de un bloque Huffman con esas longitudes, sin codificarlo. Es
+   exacto con un flujo; con cuatro, cada flujo puede redondear un byte más */
+static inline size_t TamBloqueHuffman(const unsigned long int frecuencia[256], const unsigned char longitud[256],
+                                      int flujos) {
+    uint64_t bits = 0;
+    int presentes = 0;
+
+    for(int c = 0; c < 256; c++) {
+        bits += (uint64_t)frecuencia[c] * longitud[c];
+        presentes += longitud[c] != 0;
+    }
+    if(flujos == 4) return 1 + 32 + (presentes + 1) / 2 + TAM_SALTOS + (bits + 7) / 8 + 3;
+    return 1 + 32 + (presentes + 1) / 2 + (bits + 7) / 8;
+}
+
+/* Escribe un bloque Huffman con las longitudes ya calculadas: modo (número
+   de flujos), longitudes de los códigos y flujos de bits. dst necesita
+   COTA_BLOQUE(n) bytes. Devuelve los bytes escritos */
+static inline size_t CodificarBloque(const uint8_t *src, size_t n, const unsigned char longitud[256],
+                                     int maxBits, int flujos, uint8_t *dst) {
+    tipoCodigo tabla[256];
+    tipoEscritor e;
+    uint8_t *p = dst;
+    size_t tam;
+
+    {
+        stats::Timer t(stats::build);
+        CrearTablaCodigos(longitud, 256, tabla);
+    }
+    {
+        stats::Timer t(stats::table);
+        *p++ = flujos;
+        p += EscribirLongitudes(p, longitud, 256);
+    }
+    {
+        stats::Timer t(stats::encode);
+        if(flujos == 4) tam = p - dst + CodificarHuffman4(src, n, tabla, maxBits, p);
+        else {
+            IniciarEscritor(&e, p);
+            CodificarHuffman(&e, src, n, tabla, maxBits);
+            TerminarBits(&e);
+            tam = e.p - dst;
+        }
+    }
+    stats::add(stats::symbols, n);
+    stats::add(stats::bits, 8 * (tam - (p - dst)));
+    return tam;
+}
+
+/* Comprime un bloque con su propia tabla Huffman, con la memoria de trabajo
+   de paquetes. dst necesita COTA_BLOQUE(n) bytes. Devuelve los bytes
+   escritos */
+static inline size_t ComprimirBloque(const uint8_t *src, size_t n, int maxBits, int flujos,
+                                     tipoPaquetes *paquetes, uint8_t *dst) {
+    unsigned long int frecuencia[256];
+    unsigned char longitud[256];
+    size_t tam;
+
+    {
+        stats::Timer t(stats::count);
+        Cuenta(src, n, frecuencia);
+    }
+    {
+        stats::Timer t(stats::build);
+        LongitudesHuffman(frecuencia, 256, maxBits, longitud, paquetes);
+    }
+    tam = CodificarBloque(src, n, longitud, maxBits, flujos, dst);
+    stats::add(stats::bytes_in, n);
+    stats::add(stats::bytes_out, tam);
+    return tam;
+}
+
+/* Descomprime un bloque de tam bytes que contiene n bytes originales. La tabla
+   se reconstruye sobre la que se pasa, para reutilizar su memoria. Devuelve 0,
+   o -1 si el bloque no es válido */
+static inline int DescomprimirBloque(const uint8_t *src, size_t tam, uint8_t *dst, size_t n,
+                                     tipoTablaDecodificacion *tabla) {
+    unsigned char longitud[256];
+    tipoLector l;
+    long nTabla;
+    int flujos, r;
+
+    if(tam < 1) return -1;
+    flujos = src[0];
+    if(flujos != 1 && flujos != 4) return -1;
+    {
+        stats::Timer t(stats::table);
+        nTabla = LeerLongitudes(src + 1, tam - 1, longitud, 256);
+        if(nTabla < 0) return -1;
+        CrearTablaDecodificacion(longitud, 256, tabla);
+    }
+
+    stats::add(stats::bytes_in, tam);
+    src += 1 + nTabla;
+    tam -= 1 + nTabla;
+    {
+        stats::Timer t(stats::decode);
+        if(flujos == 4) r = DecodificarHuffman4(src, tam, dst, n, tabla);
+        else {
+            IniciarLector(&l, src, src + tam);
+            DecodificarHuffman(&l, dst, n, tabla);
+            r = LectorAgotado(&l) ? -1 : 0;
+        }
+    }
+    stats::add(stats::bytes_out, n);
+    stats::add(stats::symbols, n);
+    stats::add(stats::bits, 8 * tam);
+
+    /* Los símbolos con códigos de más de BITS_TABLA bits pasan por una
+       subtabla; contarlos exige recorrer el bloque, así que sólo se hace si
+       se han pedido las estadísticas */
+    if(stats::enabled) {
+        size_t fallos = 0;
+        for(size_t i = 0; i < n; i++) fallos += longitud[dst[i]] > BITS_TABLA;
+        stats::add(stats::table_misses, fallos);
+    }
+    return r;
+}
+
+/* Escribe el índice y el pie a partir de las posiciones y longitudes de los
+   bloques. dst necesita n * TAM_ENTRADA_INDICE + TAM_PIE bytes */
+static inline size_t EscribirIndice(uint8_t *dst, const tipoBloque *bloques, size_t n, uint64_t posicion) {
+    uint8_t *p = dst;
+
+    for(size_t i = 0; i < n; i++, p += TAM_ENTRADA_INDICE) {
+        EscribirU64(p, bloques[i].posicion);
+        EscribirU32(p + 8, bloques[i].longitud);
+    }
+    EscribirU64(p, posicion);
+    EscribirU32(p + 8, n);
+    return p + TAM_PIE - dst;
+}
+
+/* Lee la cabecera, el pie y el índice de un fichero comprimido completo y
+   comprueba que son coherentes. Devuelve 0, o -1 si no es válido */
+static inline int LeerIndice(const uint8_t *datos, size_t tam, tipoIndice *indice) {
+    uint64_t posicion, inicio = 0, fin;
+    uint32_t n;
+    const uint8_t *p;
+
+    if(tam < TAM_CABECERA + TAM_PIE || LeerCabecera(datos, &indice->tamBloque) < 0) return -1;
+    posicion = LeerU64(datos + tam - TAM_PIE);
+    n = LeerU32(datos + tam - TAM_PIE + 8);
+    if(posicion < TAM_CABECERA || posicion > tam - TAM_PIE ||
+       (tam - TAM_PIE - posicion) / TAM_ENTRADA_INDICE != n ||
+       (tam - TAM_PIE - posicion) % TAM_ENTRADA_INDICE != 0) return -1;
+
+    indice->bloques.resize(n);
+    p = datos + posicion;
+    for(uint32_t i = 0; i < n; i++, p += TAM_ENTRADA_INDICE) {
+        tipoBloque *b = &indice->bloques[i];
+
+        b->posicion = LeerU64(p);
+        b->longitud = LeerU32(p + 8);
+        b->inicio = inicio;
+        inicio += b->longitud;
+        fin = i + 1 < n ? LeerU64(p + TAM_ENTRADA_INDICE) : posicion;
+        if(b->posicion < TAM_CABECERA || b->posicion > fin || b->longitud > indice->tamBloque) return -1;
+        b->tam = fin - b->posicion;
+    }
+    indice->longitud = inicio;
+    return 0;
+}
+
+/* Primer y último bloque (excluido) que contienen los bytes originales
+   [inicio, inicio + n) */
+static inline void BloquesDelRango(const tipoIndice *indice, uint64_t inicio, uint64_t n,
+                                   size_t *primero, size_t *ultimo) {
+    size_t a = 0, b = indice->bloques.size(), m;
+
+    /* Búsqueda binaria del bloque que contiene inicio */
+    while(a < b) {
+        m = (a + b) / 2;
+        if(indice->bloques[m].inicio + indice->bloques[m].longitud <= inicio) a = m + 1;
+        else b = m;
+    }
+    *primero = a;
+    for(b = a; b < indice->bloques.size() && indice->bloques[b].inicio < inicio + n; b++);
+    *ultimo = n ? b : a;
+}
+
+/* Recorta la longitud *n del rango que empieza en inicio al final del fichero
+   original. Devuelve 0, o -1 si inicio está fuera de él */
+static inline int RecortarRango(const tipoIndice *indice, uint64_t inicio, uint64_t *n) {
+    if(inicio > indice->longitud) return -1;
+    if(*n > indice->longitud - inicio) *n = indice->longitud - inicio;
+    return 0;
+}
+
+/* Parte [*desde, *hasta) del bloque b, contada desde su primer byte, que cae
+   dentro de los bytes originales [inicio, inicio + n). Sólo los bloques de los
+   extremos del rango tienen una parte menor que el bloque entero */
+static inline void ParteDelBloque(const tipoBloque *b, uint64_t inicio, uint64_t n,
+                                  uint64_t *desde, uint64_t *hasta) {
+    *desde = inicio > b->inicio ? inicio - b->inicio : 0;
+    *hasta = inicio + n < b->inicio + b->longitud ? inicio + n - b->inicio : b->longitud;
+}
+
+#endif
@@ -0,0 +1,47 @@
+#!/bin/bash
+
+# Comprueba la ida y vuelta de compres y decomp con los ficheros que se le
+# pasan: descomprimiendo a un fichero, a una tubería y sólo un rango a una
+# tubería, que tienen que dar exactamente los bytes originales. Se lanza
+# desde cualquier sitio con los programas ya compilados en MCompres/; termina
+# con error si algo falla.
+
+cd "$(dirname "$0")" || exit 1
+
+if [ $# -eq 0 ]; then
+    echo "Usar: $0 fichero..." >&2
+    exit 1
+fi
+
+tmp=$(mktemp -d) || exit 1
+trap 'rm -r "$tmp"' EXIT
+fallos=0
+
+falla() {
+    echo "FALLA: $*" >&2
+    fallos=$((fallos + 1))
+}
+
+for f in "$@"; do
+    n=$(stat -c %s "$f")
+
+    for j in 1 4; do
+        ./compres -j $j "$f" "$tmp/f.mc" || { falla "$f: compres -j $j"; continue; }
+
+        ./decomp -j $j "$tmp/f.mc" "$tmp/f.out" && cmp -s "$f" "$tmp/f.out" ||
+            falla "$f: decomp -j $j a un fichero"
+
+        ./decomp -j $j "$tmp/f.mc" /dev/stdout | cmp -s "$f" - ||
+            falla "$f: decomp -j $j a una tubería"
+
+        # Un rango que empieza y acaba a mitad de bloque
+        inicio=$((n / 3))
+        cuantos=$((n / 2))
+        ./decomp -j $j --range $inicio:$cuantos "$tmp/f.mc" /dev/stdout |
+            cmp -s <(tail -c +$((inicio + 1)) "$f" | head -c $cuantos) - ||
+            falla "$f: decomp -j $j --range $inicio:$cuantos a una tubería"
+    done
+done
+
+[ $fallos -eq 0 ] || exit 1
+echo "ida y vuelta correcta"
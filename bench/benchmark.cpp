@@ -0,0 +1,1003 @@
+///
+/// @file
+/// @brief Benchmark of every codec and mode in the repository.
+///
+/// Runs the Huffman codec of `MCompres` and the LZW codecs of `lzw` over a
+/// synthetic corpus and any files given on the command line, entirely in
+/// memory, and prints the results as JSON:
+/// - compression ratio (original size / compressed size), checked by a round trip;
+/// - throughput in MB/s, from the median time;
+/// - median, 95th and 99th percentile latency of each call;
+/// - peak resident set size while the codec ran;
+/// - optionally, cycles, instructions and cache misses per call, read with
+///   `perf_event_open()` (Linux only).
+///
+/// Every measurement is preceded by warmup runs, which are not recorded. The
+/// exit status is non-zero if any round trip fails, so that the output can be
+/// used to gate regressions.
+///
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <span>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include "../common/dictionary.hpp"
+#include "../common/parallel.hpp"
+#include "../lzw/lzw.hpp"
+#include "../MCompres/bloque.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+///
+/// @brief Command-line options.
+///
+struct Options {
+    unsigned runs {10};                             ///< measured runs per codec and input
+    unsigned warmup {1};                            ///< unrecorded runs before them
+    unsigned workers {parallel::default_workers()}; ///< threads of the parallel modes
+    std::size_t synthetic_size {4 * 1024 * 1024};   ///< bytes of every synthetic input
+    bool perf {false};                              ///< read hardware counters
+    std::vector<std::string> codecs;                ///< codecs to run; all if empty
+    std::vector<std::string> files;                 ///< real inputs
+    std::string output;                             ///< JSON file; standard output if empty
+};
+
+///
+/// @brief One input of the corpus.
+///
+struct Input {
+    std::string name;
+    std::vector<std::byte> data;
+};
+
+///
+/// @brief A codec or mode, as a pair of in-memory functions.
+///
+struct Codec {
+    std::string name;
+    std::function<void(std::span<const std::byte>, std::vector<std::byte> &)> compress;
+    std::function<void(std::span<const std::byte>, std::vector<std::byte> &)> decompress;
+};
+
+///
+/// @brief Hardware counters of one call.
+///
+struct Counters {
+    std::uint64_t cycles {0};
+    std::uint64_t instructions {0};
+    std::uint64_t cache_misses {0};
+};
+
+///
+/// @brief Summary of the runs of one direction (compression or decompression).
+///
+struct Timing {
+    std::vector<double> seconds;
+    Counters counters;          ///< sum over the runs
+};
+
+///
+/// @brief Cycles, instructions and cache misses of the process and the threads it starts.
+///
+/// The counters are opened separately rather than as a group, since inherited
+/// counters, which follow the worker threads, cannot be read as a group.
+///
+class PerfCounters {
+public:
+
+    PerfCounters()
+    {
+#ifdef __linux__
+        const std::uint64_t configs[count] {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CACHE_MISSES};
+
+        for (int c = 0; c < count; ++c)
+        {
+            perf_event_attr attr {};
+
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.size = sizeof attr;
+            attr.config = configs[c];
+            attr.disabled = 1;
+            attr.inherit = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+
+            fds[c] = static_cast<int> (syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+
+            if (fds[c] < 0)
+            {
+                error = std::strerror(errno);
+                close_all();
+                return;
+            }
+        }
+#else
+        error = "not supported on this platform";
+#endif
+    }
+
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    ~PerfCounters()
+    {
+        close_all();
+    }
+
+    ///
+    /// @brief Whether the counters could be opened; if not, `error` says why.
+    ///
+    bool available() const
+    {
+        return error.empty();
+    }
+
+    void start()
+    {
+#ifdef __linux__
+        for (const int fd : fds)
+            if (fd >= 0)
+            {
+                ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+#endif
+    }
+
+    ///
+    /// @brief Stops counting and adds the counts since `start()` to `total`.
+    ///
+    void stop(Counters &total)
+    {
+#ifdef __linux__
+        std::uint64_t values[count] {};
+
+        for (int c = 0; c < count; ++c)
+            if (fds[c] >= 0)
+            {
+                ioctl(fds[c], PERF_EVENT_IOC_DISABLE, 0);
+
+                if (read(fds[c], &values[c], sizeof values[c]) != sizeof values[c])
+                    values[c] = 0;
+            }
+
+        total.cycles += values[0];
+        total.instructions += values[1];
+        total.cache_misses += values[2];
+#else
+        static_cast<void> (total);
+#endif
+    }
+
+    std::string error;
+
+private:
+
+    void close_all()
+    {
+#ifdef __linux__
+        for (int &fd : fds)
+            if (fd >= 0)
+            {
+                close(fd);
+                fd = -1;
+            }
+#endif
+    }
+
+    static const int count {3};
+    int fds[count] {-1, -1, -1};
+};
+
+///
+/// @brief Starts measuring the peak resident set size anew, if the system allows it.
+///
+void reset_peak_rss()
+{
+#ifdef __linux__
+    // "5" resets VmHWM, the peak shown in /proc/self/status (Linux 4.0 and later)
+    std::ofstream("/proc/self/clear_refs") << "5";
+#endif
+}
+
+///
+/// @brief Peak resident set size in KiB since the last `reset_peak_rss()` or the start of the process.
+///
+long peak_rss_kb()
+{
+    std::ifstream status("/proc/self/status");
+
+    for (std::string line; std::getline(status, line);)
+        if (line.rfind("VmHWM:", 0) == 0)
+            return std::atol(line.c_str() + 6);
+
+    rusage usage {};
+
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+///
+/// @brief Compresses `in` into `out` as the `MCompres` tools do, with `flujos` bit streams per Huffman block.
+/// @param modo             `MODO_HUFFMAN`, `MODO_CONTEXTO`, or -1 to give every block the mode that suits it best
+/// @param codificadores    working memory of each of the `workers` threads, kept from one call to the next
+///
+void huffman_compress(std::span<const std::byte> in, std::vector<std::byte> &out,
+    int flujos, int modo, std::vector<tipoCodificador> &codificadores, unsigned workers)
+{
+    const std::size_t n {(in.size() + TAM_BLOQUE - 1) / TAM_BLOQUE};
+    const std::size_t window {2 * static_cast<std::size_t> (workers)};
+    const std::uint8_t *const src {reinterpret_cast<const std::uint8_t *> (in.data())};
+
+    std::vector<tipoBloque> bloques(n);
+    std::vector<std::vector<std::uint8_t>> salida(window);
+    std::vector<std::size_t> tam(window);
+
+    out.resize(TAM_CABECERA);
+    EscribirCabecera(reinterpret_cast<std::uint8_t *> (out.data()), TAM_BLOQUE);
+
+    parallel::run_ordered(n, workers, window,
+        [&](unsigned w, std::size_t i) {
+            tipoBloque &b = bloques[i];
+
+            b.inicio = i * static_cast<std::uint64_t> (TAM_BLOQUE);
+            b.longitud = static_cast<std::uint32_t> (std::min<std::uint64_t> (in.size() - b.inicio, TAM_BLOQUE));
+            salida[i % window].resize(COTA_BLOQUE(TAM_BLOQUE));
+            if (modo == MODO_CONTEXTO)
+                tam[i % window] = ComprimirBloqueContexto(src + b.inicio, b.longitud, BITS_HUFFMAN, &codificadores[w],
+                    salida[i % window].data());
+            else if (modo == MODO_HUFFMAN)
+                tam[i % window] = ComprimirBloque(src + b.inicio, b.longitud, BITS_HUFFMAN, flujos,
+                    &codificadores[w].paquetes, salida[i % window].data());
+            else
+                tam[i % window] = ComprimirBloqueAuto(src + b.inicio, b.longitud, BITS_HUFFMAN, flujos, nullptr,
+                    &codificadores[w], salida[i % window].data());
+        },
+        [&](std::size_t i) {
+            const std::byte *const p {reinterpret_cast<const std::byte *> (salida[i % window].data())};
+
+            bloques[i].posicion = out.size();
+            bloques[i].tam = tam[i % window];
+            out.insert(out.end(), p, p + tam[i % window]);
+        });
+
+    const std::size_t posicion {out.size()};
+
+    out.resize(posicion + n * TAM_ENTRADA_INDICE + TAM_PIE);
+    EscribirIndice(reinterpret_cast<std::uint8_t *> (&out[posicion]), bloques.data(), n, posicion);
+}
+
+///
+/// @brief Decompresses `in`, written by `huffman_compress()`, into `out`.
+/// @param decodificadores  working memory of each of the `workers` threads, kept from one call to the next
+///
+void huffman_decompress(std::span<const std::byte> in, std::vector<std::byte> &out,
+    std::vector<tipoDecodificador> &decodificadores, unsigned workers)
+{
+    const std::uint8_t *const datos {reinterpret_cast<const std::uint8_t *> (in.data())};
+
+    tipoIndice indice;
+
+    if (LeerIndice(datos, in.size(), &indice) < 0)
+        throw std::runtime_error("not a Huffman file");
+
+    out.resize(indice.longitud);
+
+    std::uint8_t *const dst {reinterpret_cast<std::uint8_t *> (out.data())};
+
+    // every task decompresses a run of whole blocks with the library call
+    // behind --range, a few runs per worker so that they even out
+    const std::size_t blocks {indice.bloques.size()};
+    const std::size_t runs {std::min<std::size_t> (blocks, 4 * workers)};
+
+    parallel::run(runs, workers, [&](unsigned w, std::size_t r) {
+        const tipoBloque &first {indice.bloques[r * blocks / runs]};
+        const tipoBloque &last {indice.bloques[(r + 1) * blocks / runs - 1]};
+        std::uint64_t written;
+
+        if (DescomprimirRango(datos, in.size(), &indice, first.inicio, last.inicio + last.longitud - first.inicio,
+                dst + first.inicio, &written, &decodificadores[w], nullptr) < 0)
+            throw std::runtime_error("corrupted Huffman file");
+    });
+}
+
+/// Bytes of every request of `huffman_decompress_ranges()`, which is not a multiple of the block size.
+const std::uint64_t range_size {333333};
+
+///
+/// @brief Decompresses `in`, written by `huffman_compress()`, into `out` as a series of `--range` requests.
+///
+/// The requests start and end in the middle of blocks, so most blocks are
+/// decoded by two requests, each keeping only its part, as a reader fetching
+/// records from a large compressed file would.
+///
+void huffman_decompress_ranges(std::span<const std::byte> in, std::vector<std::byte> &out,
+    std::vector<tipoDecodificador> &decodificadores, unsigned workers)
+{
+    const std::uint8_t *const datos {reinterpret_cast<const std::uint8_t *> (in.data())};
+
+    tipoIndice indice;
+
+    if (LeerIndice(datos, in.size(), &indice) < 0)
+        throw std::runtime_error("not a Huffman file");
+
+    out.resize(indice.longitud);
+
+    std::uint8_t *const dst {reinterpret_cast<std::uint8_t *> (out.data())};
+    const std::size_t requests {static_cast<std::size_t> ((indice.longitud + range_size - 1) / range_size)};
+
+    parallel::run(requests, workers, [&](unsigned w, std::size_t r) {
+        const std::uint64_t start {r * range_size};
+        std::uint64_t written;
+
+        // the last request asks for more than is left, which must be clipped
+        if (DescomprimirRango(datos, in.size(), &indice, start, range_size, dst + start, &written,
+                &decodificadores[w], nullptr) < 0)
+            throw std::runtime_error("corrupted Huffman file");
+
+        if (written != std::min(range_size, indice.longitud - start))
+            throw std::runtime_error("range decoded to the wrong size");
+    });
+}
+
+/// Bytes of every message of the dictionary codecs, the size trained dictionaries are meant for.
+const std::size_t dictionary_message_size {2 * 1024};
+
+///
+/// @brief Appends a message of `size` original bytes, compressed into `message`, to `out`.
+///
+/// Every message is preceded by its original and compressed sizes, as a
+/// service would frame the messages it stores or sends.
+///
+void append_message(std::vector<std::byte> &out, std::size_t size, std::span<const std::byte> message)
+{
+    std::uint8_t sizes[8];
+
+    EscribirU32(sizes, static_cast<std::uint32_t> (size));
+    EscribirU32(sizes + 4, static_cast<std::uint32_t> (message.size()));
+    out.insert(out.end(), reinterpret_cast<const std::byte *> (sizes), reinterpret_cast<const std::byte *> (sizes + 8));
+    out.insert(out.end(), message.begin(), message.end());
+}
+
+///
+/// @brief Reads the message at `p` of `in`, written by `append_message()`, and moves `p` past it.
+/// @param size     set to the original size of the message
+/// @returns the compressed message
+///
+std::span<const std::byte> next_message(std::span<const std::byte> in, std::size_t &p, std::size_t &size)
+{
+    if (in.size() - p < 8)
+        throw std::runtime_error("truncated message");
+
+    const std::uint8_t *const sizes {reinterpret_cast<const std::uint8_t *> (&in[p])};
+    const std::size_t n {LeerU32(sizes + 4)};
+
+    size = LeerU32(sizes);
+
+    if (in.size() - p - 8 < n)
+        throw std::runtime_error("truncated message");
+
+    p += 8 + n;
+    return in.subspan(p - n, n);
+}
+
+///
+/// @brief Compresses every message of `in` as one `MCompres` block with the trained dictionary `estatico`.
+/// @param modo     `MODO_ESTATICO` to use its static Huffman code for every block, or -1 to give every
+///                 block the mode that suits it best, which for text is mostly its primed LZW dictionary
+///                 (`MODO_LZW_CEBADO`)
+///
+void mcompres_dictionary_compress(std::span<const std::byte> in, std::vector<std::byte> &out, int modo,
+    const tipoEstatico &estatico, tipoCodificador &codificador)
+{
+    const std::uint8_t *const src {reinterpret_cast<const std::uint8_t *> (in.data())};
+
+    std::vector<std::byte> block(COTA_BLOQUE(dictionary_message_size));
+
+    for (std::size_t p = 0; p < in.size(); p += dictionary_message_size)
+    {
+        const std::size_t n {std::min(dictionary_message_size, in.size() - p)};
+        std::uint8_t *const dst {reinterpret_cast<std::uint8_t *> (block.data())};
+        const std::size_t tam {modo == MODO_ESTATICO ? CodificarEstatico(src + p, n, &estatico, dst)
+            : ComprimirBloqueAuto(src + p, n, BITS_HUFFMAN, 1, &estatico, &codificador, dst)};
+
+        append_message(out, n, std::span<const std::byte>(block.data(), tam));
+    }
+}
+
+///
+/// @brief Decompresses what `mcompres_dictionary_compress()` wrote.
+///
+void mcompres_dictionary_decompress(std::span<const std::byte> in, std::vector<std::byte> &out,
+    const tipoEstatico &estatico, tipoDecodificador &decodificador)
+{
+    for (std::size_t p = 0, n; p < in.size();)
+    {
+        const std::span<const std::byte> block {next_message(in, p, n)};
+        const std::size_t start {out.size()};
+
+        out.resize(start + n);
+
+        if (DescomprimirBloqueAuto(reinterpret_cast<const std::uint8_t *> (block.data()), block.size(),
+                reinterpret_cast<std::uint8_t *> (&out[start]), n, &decodificador, &estatico) < 0)
+            throw std::runtime_error("corrupted dictionary block");
+    }
+}
+
+///
+/// @brief Compresses every message of `in` with `coder`, in the primed LZW format.
+///
+void lzw_primed_compress(std::span<const std::byte> in, std::vector<std::byte> &out, lzw::PrimedCompressor &coder)
+{
+    std::vector<std::byte> message;
+
+    for (std::size_t p = 0; p < in.size(); p += dictionary_message_size)
+    {
+        const std::size_t n {std::min(dictionary_message_size, in.size() - p)};
+
+        message.clear();
+        coder.compress(in.subspan(p, n), message);
+        append_message(out, n, message);
+    }
+}
+
+///
+/// @brief Decompresses what `lzw_primed_compress()` wrote.
+///
+void lzw_primed_decompress(std::span<const std::byte> in, std::vector<std::byte> &out, lzw::PrimedDecompressor &coder)
+{
+    for (std::size_t p = 0, n; p < in.size();)
+    {
+        const std::span<const std::byte> message {next_message(in, p, n)};
+        const std::size_t start {out.size()};
+
+        out.resize(start + n);
+
+        if (coder.decompress(message, std::span<std::byte>(&out[start], n)) != n)
+            throw std::runtime_error("primed LZW message decoded to the wrong size");
+    }
+}
+
+/// Bytes between two flush points of the stream codec, as if the input were a series of messages.
+const std::size_t stream_message_size {4 * 1024};
+
+///
+/// @brief Compresses `in` in the LZW stream format, with a flush point after every message.
+///
+/// Every message is compressed into a buffer of its own and then sent on, here
+/// appended to `out`, as a producer writing to a socket would.
+///
+void lzw_stream_compress(std::span<const std::byte> in, std::vector<std::byte> &out)
+{
+    lzw::StreamCompressor coder;
+    std::vector<std::byte> message;
+    std::size_t p {0};
+
+    do
+    {
+        const std::size_t n {std::min(stream_message_size, in.size() - p)};
+
+        message.clear();
+        coder.compress(in.subspan(p, n), message);
+        coder.flush(message);
+        out.insert(out.end(), message.begin(), message.end());
+        p += n;
+    }
+    while (p < in.size());
+}
+
+///
+/// @brief Decompresses what `lzw_stream_compress()` wrote.
+///
+void lzw_stream_decompress(std::span<const std::byte> in, std::vector<std::byte> &out)
+{
+    lzw::StreamDecompressor().decompress(in, out);
+}
+
+///
+/// @brief Decompresses what `lzw_stream_compress()` wrote, fed in pieces of uneven sizes.
+///
+/// The pieces split the header, codes and flush points wherever they fall,
+/// as reads from a socket would. Every piece is decompressed into a buffer of
+/// its own and then appended to `out`.
+///
+void lzw_stream_decompress_chunked(std::span<const std::byte> in, std::vector<std::byte> &out)
+{
+    static const std::size_t sizes[] {1, 3, 7, 64, 509, 4093};
+
+    lzw::StreamDecompressor coder;
+    std::vector<std::byte> piece;
+
+    for (std::size_t p = 0, i = 0; p < in.size(); ++i)
+    {
+        const std::size_t n {std::min(sizes[i % std::size(sizes)], in.size() - p)};
+
+        piece.clear();
+        coder.decompress(in.subspan(p, n), piece);
+        out.insert(out.end(), piece.begin(), piece.end());
+        p += n;
+    }
+}
+
+///
+/// @brief Text made of words drawn with a Zipf-like distribution, in lines of varying length.
+///
+std::vector<std::byte> synthetic_text(std::size_t size, std::mt19937_64 &rng)
+{
+    static const char *const words[] {"the", "of", "and", "to", "in", "a", "is", "that", "for",
+        "it", "as", "was", "with", "be", "by", "on", "not", "he", "this", "are", "or", "his",
+        "from", "at", "which", "but", "have", "an", "had", "they", "you", "were", "their",
+        "one", "all", "we", "can", "her", "has", "there", "been", "if", "more", "when", "will",
+        "would", "who", "so", "no", "compression", "dictionary", "symbol", "table", "block"};
+    const std::size_t count {std::size(words)};
+
+    std::vector<double> weights(count);
+
+    for (std::size_t w = 0; w < count; ++w)
+        weights[w] = 1.0 / (w + 1);
+
+    std::discrete_distribution<std::size_t> word(weights.begin(), weights.end());
+    std::string text;
+
+    text.reserve(size + 16);
+
+    for (unsigned column = 0; text.size() < size;)
+    {
+        const char *const w {words[word(rng)]};
+
+        text += w;
+        column += std::strlen(w) + 1;
+
+        if (column > 60 + rng() % 20)
+        {
+            text += ".\n";
+            column = 0;
+        }
+        else
+            text += ' ';
+    }
+
+    text.resize(size);
+    return {reinterpret_cast<const std::byte *> (text.data()), reinterpret_cast<const std::byte *> (text.data()) + size};
+}
+
+///
+/// @brief Comma-separated records with a timestamp, an identifier, a category and a value.
+///
+std::vector<std::byte> synthetic_csv(std::size_t size, std::mt19937_64 &rng)
+{
+    static const char *const categories[] {"alpha", "beta", "gamma", "delta"};
+
+    std::string csv {"timestamp,id,category,value\n"};
+    char line[96];
+
+    for (std::uint64_t t = 1700000000; csv.size() < size; t += rng() % 5)
+    {
+        std::snprintf(line, sizeof line, "%llu,%llu,%s,%.3f\n", static_cast<unsigned long long> (t),
+            static_cast<unsigned long long> (rng() % 10000), categories[rng() % 4], (rng() % 1000000) / 7.0);
+        csv += line;
+    }
+
+    csv.resize(size);
+    return {reinterpret_cast<const std::byte *> (csv.data()), reinterpret_cast<const std::byte *> (csv.data()) + size};
+}
+
+///
+/// @brief The synthetic part of the corpus: `size` bytes of each kind of data.
+///
+/// The inputs are generated with a fixed seed, so that every run measures the same data.
+///
+std::vector<Input> synthetic_corpus(std::size_t size)
+{
+    std::mt19937_64 rng(2024);
+    std::vector<Input> corpus;
+
+    corpus.push_back({"synthetic/zeros", std::vector<std::byte>(size)});
+
+    std::vector<std::byte> random(size);
+
+    for (std::byte &b : random)
+        b = static_cast<std::byte> (rng());
+
+    corpus.push_back({"synthetic/random", random});
+    corpus.push_back({"synthetic/text", synthetic_text(size, rng)});
+    corpus.push_back({"synthetic/csv", synthetic_csv(size, rng)});
+
+    // alternating 64 KiB stretches of text and random bytes, like an archive of
+    // documents and already compressed media
+    std::vector<std::byte> mixed(corpus[2].data);
+    const std::size_t stretch {64 * 1024};
+
+    for (std::size_t p = stretch; p < size; p += 2 * stretch)
+        std::copy_n(random.begin() + p, std::min(stretch, size - p), mixed.begin() + p);
+
+    corpus.push_back({"synthetic/mixed", mixed});
+    return corpus;
+}
+
+///
+/// @brief Dictionary for the dictionary codecs, trained on synthetic text and CSV.
+///
+/// The training data comes from another seed than the corpus, so the
+/// dictionary suits the synthetic text and CSV inputs without having seen
+/// them, as a dictionary trained on past messages suits new ones.
+///
+dictionary::Dictionary training_dictionary()
+{
+    const std::size_t size {256 * 1024};
+
+    std::mt19937_64 rng(1789);
+    std::vector<std::byte> corpus {synthetic_text(size, rng)};
+    const std::vector<std::byte> csv {synthetic_csv(size, rng)};
+
+    corpus.insert(corpus.end(), csv.begin(), csv.end());
+    return dictionary::train(corpus);
+}
+
+///
+/// @brief Every codec and mode, with the default settings of the command-line tools.
+///
+std::vector<Codec> all_codecs(unsigned workers)
+{
+    using Buffer = std::vector<std::byte>;
+    using Span = std::span<const std::byte>;
+
+    // the codecs keep their working memory between calls, as a service would
+    const auto enc {std::make_shared<std::vector<tipoCodificador>> (workers)};
+    const auto dec {std::make_shared<std::vector<tipoDecodificador>> (workers)};
+    const auto lzw_enc {std::make_shared<lzw::Compressor> ()};
+    const auto lzw_dec {std::make_shared<lzw::Decompressor> ()};
+
+    // the dictionary codecs compress one message at a time, on one thread
+    const auto dict {std::make_shared<const dictionary::Dictionary> (training_dictionary())};
+    const auto estatico {std::make_shared<tipoEstatico> ()};
+    const auto dict_enc {std::make_shared<tipoCodificador> ()};
+    const auto dict_dec {std::make_shared<tipoDecodificador> ()};
+    const auto primed_enc {std::make_shared<lzw::PrimedCompressor> (*dict)};
+    const auto primed_dec {std::make_shared<lzw::PrimedDecompressor> (*dict)};
+
+    CrearEstatico(dict.get(), estatico.get());
+
+    return {
+        {"huffman",
+            [=](Span in, Buffer &out) { huffman_compress(in, out, 1, MODO_HUFFMAN, *enc, workers); },
+            [=](Span in, Buffer &out) { huffman_decompress(in, out, *dec, workers); }},
+        {"huffman4",
+            [=](Span in, Buffer &out) { huffman_compress(in, out, 4, MODO_HUFFMAN, *enc, workers); },
+            [=](Span in, Buffer &out) { huffman_decompress(in, out, *dec, workers); }},
+        {"mcompres-auto",
+            [=](Span in, Buffer &out) { huffman_compress(in, out, 1, -1, *enc, workers); },
+            [=](Span in, Buffer &out) { huffman_decompress(in, out, *dec, workers); }},
+        {"mcompres-range",
+            [=](Span in, Buffer &out) { huffman_compress(in, out, 1, -1, *enc, workers); },
+            [=](Span in, Buffer &out) { huffman_decompress_ranges(in, out, *dec, workers); }},
+        {"mcompres-dictionary",
+            [=](Span in, Buffer &out) { mcompres_dictionary_compress(in, out, -1, *estatico, *dict_enc); },
+            [=](Span in, Buffer &out) { mcompres_dictionary_decompress(in, out, *estatico, *dict_dec); }},
+        {"mcompres-static",
+            [=](Span in, Buffer &out) { mcompres_dictionary_compress(in, out, MODO_ESTATICO, *estatico, *dict_enc); },
+            [=](Span in, Buffer &out) { mcompres_dictionary_decompress(in, out, *estatico, *dict_dec); }},
+        {"huffman-order1",
+            [=](Span in, Buffer &out) { huffman_compress(in, out, 1, MODO_CONTEXTO, *enc, workers); },
+            [=](Span in, Buffer &out) { huffman_decompress(in, out, *dec, workers); }},
+        {"lzw",
+            [](Span in, Buffer &out) { lzw::compress(in, out); },
+            [](Span in, Buffer &out) { lzw::decompress(in, out); }},
+        {"lzw-variable",
+            [](Span in, Buffer &out) { lzw::compress_variable(in, out); },
+            [](Span in, Buffer &out) { lzw::decompress_variable(in, out); }},
+        {"lzw-variable-context",
+            [=](Span in, Buffer &out) { lzw_enc->compress_variable(in, out); },
+            [=](Span in, Buffer &out) { lzw_dec->decompress_variable(in, out); }},
+        {"lzw-primed",
+            [=](Span in, Buffer &out) { lzw_primed_compress(in, out, *primed_enc); },
+            [=](Span in, Buffer &out) { lzw_primed_decompress(in, out, *primed_dec); }},
+        {"lzw-parallel",
+            [workers](Span in, Buffer &out) { lzw::compress_parallel(in, out, lzw::globals::default_width, workers); },
+            [workers](Span in, Buffer &out) { lzw::decompress_parallel(in, out, workers); }},
+        {"lzw-hybrid",
+            [](Span in, Buffer &out) { lzw::compress_hybrid(in, out); },
+            [](Span in, Buffer &out) { lzw::decompress_hybrid(in, out); }},
+        {"lzw-stream", lzw_stream_compress, lzw_stream_decompress},
+        {"lzw-stream-chunked", lzw_stream_compress, lzw_stream_decompress_chunked},
+    };
+}
+
+///
+/// @brief Value at fraction `q` of the sorted `values`, by the nearest-rank method.
+///
+double percentile(std::vector<double> values, double q)
+{
+    std::sort(values.begin(), values.end());
+
+    const std::size_t rank {static_cast<std::size_t> (q * values.size() + 0.999999)};
+
+    return values[std::clamp<std::size_t> (rank, 1, values.size()) - 1];
+}
+
+///
+/// @brief Runs `f` `warmup` + `runs` times and records the measured runs.
+///
+template <typename F>
+Timing measure(F f, const Options &options, PerfCounters &perf)
+{
+    Timing timing;
+
+    for (unsigned r = 0; r < options.warmup + options.runs; ++r)
+    {
+        const bool recorded {r >= options.warmup};
+
+        if (recorded && options.perf)
+            perf.start();
+
+        const auto start = std::chrono::steady_clock::now();
+
+        f();
+
+        const auto finish = std::chrono::steady_clock::now();
+
+        if (recorded && options.perf)
+            perf.stop(timing.counters);
+
+        if (recorded)
+            timing.seconds.push_back(std::chrono::duration<double> (finish - start).count());
+    }
+
+    return timing;
+}
+
+///
+/// @brief Escapes `s` for a JSON string.
+///
+std::string json_string(const std::string &s)
+{
+    std::string quoted {"\""};
+
+    for (const char c : s)
+    {
+        if (c == '"' || c == '\\')
+            quoted += '\\';
+
+        if (static_cast<unsigned char> (c) < 0x20)
+        {
+            char escaped[8];
+
+            std::snprintf(escaped, sizeof escaped, "\\u%04x", c);
+            quoted += escaped;
+        }
+        else
+            quoted += c;
+    }
+
+    return quoted + '"';
+}
+
+///
+/// @brief Writes the summary of `timing` as a JSON object.
+///
+void write_timing(std::ostream &os, const Timing &timing, std::size_t bytes, const Options &options)
+{
+    const double median {percentile(timing.seconds, 0.5)};
+
+    os << "{\"mb_per_s\": " << bytes / median / 1e6
+       << ", \"median_ms\": " << median * 1e3
+       << ", \"p95_ms\": " << percentile(timing.seconds, 0.95) * 1e3
+       << ", \"p99_ms\": " << percentile(timing.seconds, 0.99) * 1e3;
+
+    if (options.perf)
+    {
+        const Counters &c = timing.counters;
+
+        os << ", \"cycles\": " << c.cycles / options.runs
+           << ", \"instructions\": " << c.instructions / options.runs
+           << ", \"cache_misses\": " << c.cache_misses / options.runs
+           << ", \"cycles_per_byte\": " << (bytes != 0 ? static_cast<double> (c.cycles) / options.runs / bytes : 0)
+           << ", \"ipc\": " << (c.cycles != 0 ? static_cast<double> (c.instructions) / c.cycles : 0);
+    }
+
+    os << '}';
+}
+
+///
+/// @brief Prints usage information.
+///
+void print_usage(const char *program)
+{
+    std::cerr << "Usage:\n\t" << program << " [options] [file...]\n\n";
+    std::cerr << "Options:\n";
+    std::cerr << "\t-n runs       measured runs per codec and input (10 by default)\n";
+    std::cerr << "\t-w runs       warmup runs before them (1 by default)\n";
+    std::cerr << "\t-j threads    threads of the parallel modes (" << parallel::default_workers() << " by default)\n";
+    std::cerr << "\t-s bytes      size of every synthetic input, 0 to leave them out (4 MiB by default)\n";
+    std::cerr << "\t-c codec      run only this codec; may be repeated\n";
+    std::cerr << "\t-o file       write the JSON report to `file' instead of the standard output\n";
+    std::cerr << "\t--perf        also count cycles, instructions and cache misses\n\n";
+    std::cerr << "Codecs:\n\t";
+
+    for (const Codec &c : all_codecs(1))
+        std::cerr << c.name << ' ';
+
+    std::cerr << '\n';
+}
+
+///
+/// @brief Parses the command line into `options`.
+/// @returns false if it is not valid
+///
+bool parse_options(int argc, char *argv[], Options &options)
+{
+    for (int a = 1; a < argc; ++a)
+    {
+        const std::string option {argv[a]};
+
+        if (option == "--perf")
+            options.perf = true;
+        else
+        if (option.size() == 2 && option[0] == '-' && a + 1 < argc)
+        {
+            const char *const value {argv[++a]};
+
+            switch (option[1])
+            {
+            case 'n': options.runs = std::atoi(value); break;
+            case 'w': options.warmup = std::atoi(value); break;
+            case 'j': options.workers = std::atoi(value); break;
+            case 's': options.synthetic_size = std::strtoull(value, nullptr, 10); break;
+            case 'c': options.codecs.push_back(value); break;
+            case 'o': options.output = value; break;
+            default: return false;
+            }
+        }
+        else
+        if (option[0] != '-')
+            options.files.push_back(option);
+        else
+            return false;
+    }
+
+    return options.runs >= 1 && options.workers >= 1;
+}
+
+} // namespace
+
+///
+/// @brief Runs the benchmark.
+/// @retval EXIT_FAILURE    for invalid arguments, unreadable inputs or failed round trips
+/// @retval EXIT_SUCCESS    otherwise
+///
+int main(int argc, char *argv[])
+{
+    Options options;
+
+    if (!parse_options(argc, argv, options))
+    {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<Codec> codecs {all_codecs(options.workers)};
+
+    if (!options.codecs.empty())
+    {
+        std::vector<Codec> chosen;
+
+        for (const std::string &name : options.codecs)
+        {
+            const auto c = std::find_if(codecs.begin(), codecs.end(), [&name](const Codec &c) { return c.name == name; });
+
+            if (c == codecs.end())
+            {
+                std::cerr << "ERROR: codec `" << name << "' is not recognized.\n";
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+
+            chosen.push_back(*c);
+        }
+
+        codecs = chosen;
+    }
+
+    std::vector<Input> corpus;
+
+    if (options.synthetic_size != 0)
+        corpus = synthetic_corpus(options.synthetic_size);
+
+    for (const std::string &name : options.files)
+    {
+        std::ifstream file(name, std::ios_base::binary);
+
+        if (!file)
+        {
+            std::cerr << "ERROR: `" << name << "' could not be opened.\n";
+            return EXIT_FAILURE;
+        }
+
+        const std::vector<char> data {std::istreambuf_iterator<char> (file), std::istreambuf_iterator<char> ()};
+
+        corpus.push_back({name, {reinterpret_cast<const std::byte *> (data.data()),
+            reinterpret_cast<const std::byte *> (data.data()) + data.size()}});
+    }
+
+    PerfCounters perf;
+
+    if (options.perf && !perf.available())
+        std::cerr << "WARNING: hardware counters are not available (" << perf.error << ").\n";
+
+    options.perf = options.perf && perf.available();
+
+    std::ostringstream report;
+    bool all_passed {true};
+
+    report << "{\n  \"runs\": " << options.runs << ", \"warmup\": " << options.warmup
+           << ", \"workers\": " << options.workers << ", \"perf\": " << (options.perf ? "true" : "false")
+           << ",\n  \"results\": [";
+
+    const char *separator {"\n"};
+
+    for (const Codec &codec : codecs)
+        for (const Input &input : corpus)
+        {
+            std::vector<std::byte> compressed;
+            std::vector<std::byte> decompressed;
+
+            std::cerr << codec.name << ' ' << input.name << '\n';
+            reset_peak_rss();
+
+            const Timing c {measure([&] { compressed.clear(); codec.compress(input.data, compressed); }, options, perf)};
+            const Timing d {measure([&] { decompressed.clear(); codec.decompress(compressed, decompressed); }, options, perf)};
+            const bool passed {decompressed == input.data};
+
+            all_passed = all_passed && passed;
+
+            report << separator << "    {\"codec\": " << json_string(codec.name)
+                   << ", \"input\": " << json_string(input.name)
+                   << ", \"input_bytes\": " << input.data.size()
+                   << ", \"compressed_bytes\": " << compressed.size()
+                   << ", \"ratio\": " << (compressed.empty() ? 0 : static_cast<double> (input.data.size()) / compressed.size())
+                   << ", \"roundtrip\": " << (passed ? "true" : "false")
+                   << ", \"peak_rss_kb\": " << peak_rss_kb()
+                   << ",\n     \"compress\": ";
+            write_timing(report, c, input.data.size(), options);
+            report << ",\n     \"decompress\": ";
+            write_timing(report, d, input.data.size(), options);
+            report << '}';
+            separator = ",\n";
+        }
+
+    report << "\n  ]\n}\n";
+
+    if (options.output.empty())
+        std::cout << report.str();
+    else
+    if (!(std::ofstream(options.output) << report.str()))
+    {
+        std::cerr << "ERROR: `" << options.output << "' could not be written.\n";
+        return EXIT_FAILURE;
+    }
+
+    return all_passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
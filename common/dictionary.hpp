@@ -0,0 +1,238 @@
+///
+/// @file
+/// @brief Trained dictionaries for compressing many small messages.
+///
+/// A message of a few kilobytes is too short for the codecs to learn much from
+/// it: an MCompres block spends a hundred bytes or so on its Huffman table, and
+/// an LZW dictionary only starts paying off after the first few thousand bytes.
+/// A dictionary trained beforehand on a sample of typical messages holds both
+/// things, ready for every message:
+/// - a static Huffman code, with a code for every byte, that MCompres blocks
+///   can use instead of carrying their own table;
+/// - a sample of the most common strings of the corpus, with which the LZW
+///   coders prime their dictionaries once and then reset to for every message.
+///
+/// Dictionaries are saved to a file with an ID, which the compressed data
+/// records so that decompressing with the wrong dictionary fails instead of
+/// producing garbage.
+///
+
+#ifndef COMMON_DICTIONARY_HPP
+#define COMMON_DICTIONARY_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <queue>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "../MCompres/huffman.h"
+
+namespace dictionary {
+
+/// Magic bytes at the start of a dictionary file, followed by the format version.
+const char magic[3] {'D', 'I', 'C'};
+
+/// Version of the dictionary file format.
+const char format_version {1};
+
+/// Default size of the LZW sample.
+const std::size_t default_sample_size {32 * 1024};
+
+/// Bytes of the corpus that are picked or left out together when building the sample.
+const std::size_t segment_size {256};
+
+/// Length of the strings whose frequency decides how useful a segment is.
+const std::size_t kmer_size {8};
+
+///
+/// @brief A trained dictionary.
+///
+struct Dictionary {
+    std::uint32_t id {0};                   ///< identifies the dictionary in compressed data; never 0
+    unsigned char lengths[256] {};          ///< static Huffman code lengths, none of them 0
+    std::vector<std::byte> sample;          ///< strings that prime the LZW dictionaries
+};
+
+namespace detail {
+
+///
+/// @brief FNV-1a hash of `data`, continuing from `h`.
+///
+inline std::uint32_t hash(const void *data, std::size_t n, std::uint32_t h = 2166136261u)
+{
+    const unsigned char *p {static_cast<const unsigned char *> (data)};
+
+    for (std::size_t i = 0; i < n; ++i)
+        h = (h ^ p[i]) * 16777619u;
+
+    return h;
+}
+
+///
+/// @brief Slot of the string of `kmer_size` bytes at `p` in a table of `1 << bits` counters.
+///
+inline std::size_t kmer_slot(const std::byte *p, unsigned bits)
+{
+    std::uint64_t v;
+
+    std::memcpy(&v, p, sizeof v);
+    return static_cast<std::size_t> ((v * 0x9E3779B97F4A7C15ull) >> (64 - bits));
+}
+
+} // namespace detail
+
+///
+/// @brief Picks the segments of `corpus` that best cover its common strings, up to `sample_size` bytes.
+///
+/// Every segment is worth the sum of the frequencies of the strings of
+/// `kmer_size` bytes it contains, and once a segment is picked its strings are
+/// worth nothing to the others, so the sample does not repeat itself. The
+/// segments are taken greedily; since their worth only goes down, a segment
+/// whose worth is still up to date when it reaches the top of the queue is the
+/// best one left.
+///
+inline std::vector<std::byte> pick_sample(std::span<const std::byte> corpus, std::size_t sample_size)
+{
+    const unsigned bits {20};
+
+    if (corpus.size() <= sample_size)
+        return std::vector<std::byte> (corpus.begin(), corpus.end());
+
+    std::vector<std::uint32_t> counts(std::size_t {1} << bits);
+    const std::size_t kmers {corpus.size() >= kmer_size ? corpus.size() - kmer_size + 1 : 0};
+
+    for (std::size_t i = 0; i < kmers; ++i)
+        ++counts[detail::kmer_slot(&corpus[i], bits)];
+
+    const auto worth = [&](std::size_t segment) {
+        const std::size_t end {std::min(segment + segment_size, kmers)};
+        std::uint64_t w {0};
+
+        for (std::size_t i = segment; i < end; ++i)
+            w += counts[detail::kmer_slot(&corpus[i], bits)];
+
+        return w;
+    };
+
+    std::priority_queue<std::pair<std::uint64_t, std::size_t>> queue;
+    std::vector<std::byte> sample;
+
+    for (std::size_t s = 0; s < corpus.size(); s += segment_size)
+        queue.push({worth(s), s});
+
+    while (sample.size() < sample_size && !queue.empty())
+    {
+        const std::size_t s {queue.top().second};
+        const std::uint64_t w {worth(s)};
+
+        queue.pop();
+
+        if (!queue.empty() && w < queue.top().first)
+        {
+            queue.push({w, s});
+            continue;
+        }
+
+        const std::size_t n {std::min({segment_size, corpus.size() - s, sample_size - sample.size()})};
+
+        sample.insert(sample.end(), corpus.begin() + s, corpus.begin() + s + n);
+
+        for (std::size_t i = s; i < std::min(s + segment_size, kmers); ++i)
+            counts[detail::kmer_slot(&corpus[i], bits)] = 0;
+    }
+
+    return sample;
+}
+
+///
+/// @brief Trains a dictionary on `corpus`, a concatenation of typical messages.
+/// @param sample_size      largest size of the LZW sample
+/// @param id               ID of the dictionary; if 0, one is derived from its contents
+///
+/// Every byte gets a Huffman code, even those the corpus lacks, so that the
+/// static code can encode any message. The codes may be as long as the block
+/// format allows: the missing bytes then take the longest codes and next to
+/// none of the code space, rather than lengthening the codes of the bytes
+/// that do occur.
+///
+inline Dictionary train(std::span<const std::byte> corpus, std::size_t sample_size = default_sample_size,
+    std::uint32_t id = 0)
+{
+    Dictionary d;
+    unsigned long int frequency[256];
+    tipoPaquetes scratch;
+
+    Cuenta(reinterpret_cast<const std::uint8_t *> (corpus.data()), corpus.size(), frequency);
+
+    for (unsigned long int &f : frequency)
+        ++f;
+
+    LongitudesHuffman(frequency, 256, MAX_BITS_HUFFMAN, d.lengths, &scratch);
+    d.sample = pick_sample(corpus, sample_size);
+
+    if (id == 0)
+        id = detail::hash(d.sample.data(), d.sample.size(), detail::hash(d.lengths, sizeof d.lengths));
+
+    d.id = id != 0 ? id : 1;
+    return d;
+}
+
+///
+/// @brief Writes `d` in the dictionary file format.
+///
+/// The file holds the magic bytes and version, the ID, the code lengths as in
+/// an MCompres block, and the size of the sample followed by the sample.
+///
+inline std::vector<std::byte> save(const Dictionary &d)
+{
+    std::vector<std::byte> out(sizeof magic + 5 + TAM_MAX_TABLA(256) + 4);
+
+    std::memcpy(out.data(), magic, sizeof magic);
+    out[sizeof magic] = static_cast<std::byte> (format_version);
+    EscribirU32(reinterpret_cast<std::uint8_t *> (&out[sizeof magic + 1]), d.id);
+
+    std::size_t p {sizeof magic + 5};
+
+    p += EscribirLongitudes(reinterpret_cast<std::uint8_t *> (&out[p]), d.lengths, 256);
+    out.resize(p + 4);
+    EscribirU32(reinterpret_cast<std::uint8_t *> (&out[p]), static_cast<std::uint32_t> (d.sample.size()));
+    out.insert(out.end(), d.sample.begin(), d.sample.end());
+    return out;
+}
+
+///
+/// @brief Reads a dictionary written by `save()`, checking that it is complete and consistent.
+///
+inline Dictionary load(std::span<const std::byte> in)
+{
+    const std::uint8_t *const p {reinterpret_cast<const std::uint8_t *> (in.data())};
+    Dictionary d;
+
+    if (in.size() < sizeof magic + 5 || std::memcmp(p, magic, sizeof magic) != 0
+        || static_cast<char> (in[sizeof magic]) != format_version)
+        throw std::runtime_error("not a dictionary file");
+
+    d.id = LeerU32(p + sizeof magic + 1);
+
+    std::size_t pos {sizeof magic + 5};
+    const long n {LeerLongitudes(p + pos, in.size() - pos, d.lengths, 256)};
+
+    if (d.id == 0 || n < 0 || std::count(d.lengths, d.lengths + 256, 0) != 0)
+        throw std::runtime_error("corrupted dictionary file");
+
+    pos += n;
+
+    if (in.size() - pos < 4 || in.size() - pos - 4 != LeerU32(p + pos))
+        throw std::runtime_error("corrupted dictionary file");
+
+    d.sample.assign(in.begin() + pos + 4, in.end());
+    return d;
+}
+
+} // namespace dictionary
+
+#endif // COMMON_DICTIONARY_HPP
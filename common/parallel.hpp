@@ -0,0 +1,170 @@
+///
+/// @file
+/// @brief Parallel loops shared by the command-line tools.
+///
+/// Both codecs split their input into independent blocks. The helpers in this
+/// file run a function over every block index on a fixed number of threads,
+/// optionally handing the results back in index order so they can be written
+/// out sequentially. The threads are started and joined by every call, which
+/// suits one call over a whole buffer; streams of blocks go through the
+/// persistent workers of `pipeline.hpp` instead.
+///
+
+#ifndef COMMON_PARALLEL_HPP
+#define COMMON_PARALLEL_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace parallel {
+
+///
+/// @brief Number of workers used when the user does not ask for a specific count.
+///
+inline unsigned default_workers()
+{
+    const unsigned n = std::thread::hardware_concurrency();
+
+    return n != 0 ? n : 1;
+}
+
+///
+/// @brief Runs `task(worker, i)` for every `i` in `[0, count)` and calls `done(i)`
+///        on the calling thread in increasing order of `i`.
+/// @param count        number of tasks
+/// @param workers      number of threads running tasks
+/// @param window       maximum number of tasks started but not yet handed to `done`
+/// @param task         callable `(unsigned worker, std::size_t i)`
+/// @param done         callable `(std::size_t i)`
+///
+/// Since no more than `window` tasks are in flight, callers can keep their
+/// results in `window` slots indexed by `i % window`. Each `worker` index is
+/// used by one thread at a time, so it can select per-thread scratch state.
+/// The first exception thrown by a task is rethrown after all threads stop.
+///
+template <typename Task, typename Done>
+void run_ordered(std::size_t count, unsigned workers, std::size_t window, Task task, Done done)
+{
+    if (workers > count)
+        workers = static_cast<unsigned> (count);
+
+    if (window == 0)
+        window = 1;
+
+    if (workers <= 1)
+    {
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            task(0, i);
+            done(i);
+        }
+
+        return;
+    }
+
+    std::mutex m;
+    std::condition_variable cv;
+    std::vector<char> ready(count, 0);
+    std::size_t next {0};       // next task to start
+    std::size_t delivered {0};  // tasks already handed to `done`
+    std::exception_ptr error;
+
+    const auto worker_loop = [&](unsigned w) {
+        for (;;)
+        {
+            std::size_t i;
+
+            {
+                std::unique_lock<std::mutex> lock(m);
+
+                cv.wait(lock, [&] { return error || next >= count || next < delivered + window; });
+
+                if (error || next >= count)
+                    return;
+
+                i = next++;
+            }
+
+            try
+            {
+                task(w, i);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(m);
+
+                if (!error)
+                    error = std::current_exception();
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m);
+
+                ready[i] = 1;
+            }
+
+            cv.notify_all();
+        }
+    };
+
+    std::vector<std::thread> threads;
+
+    for (unsigned w = 0; w < workers; ++w)
+        threads.emplace_back(worker_loop, w);
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m);
+
+            cv.wait(lock, [&] { return error || ready[i]; });
+
+            if (error)
+                break;
+        }
+
+        try
+        {
+            done(i);
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(m);
+
+            error = std::current_exception();
+            cv.notify_all();
+            break;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m);
+
+            delivered = i + 1;
+        }
+
+        cv.notify_all();
+    }
+
+    for (auto &t : threads)
+        t.join();
+
+    if (error)
+        std::rethrow_exception(error);
+}
+
+///
+/// @brief Runs `task(worker, i)` for every `i` in `[0, count)` in no particular order.
+///
+template <typename Task>
+void run(std::size_t count, unsigned workers, Task task)
+{
+    run_ordered(count, workers, count, task, [](std::size_t) {});
+}
+
+} // namespace parallel
+
+#endif // COMMON_PARALLEL_HPP
@@ -0,0 +1,302 @@
+///
+/// @file
+/// @brief Three-stage pipeline shared by the command-line tools: reader, codec and writer.
+///
+/// A reader thread loads the input block by block, a set of worker threads,
+/// started once, run the codec over the blocks as they come, and a writer
+/// thread stores the results in order. While the workers code some blocks, the
+/// next ones are being read and the previous ones written, so neither the
+/// processor nor the storage waits for the other, and a slow block only holds
+/// up its own worker.
+///
+/// The stages hand blocks to each other through bounded single-producer,
+/// single-consumer rings; the workers take turns on their side of a ring. The
+/// workers finish in any order, so their results go through a reorder step
+/// that passes them on to the writer in the order they were read. Blocks come
+/// from two fixed pools, one for input and one for output, and go back to them
+/// once used, so their buffers are allocated only when a block first needs
+/// more room.
+///
+
+#ifndef COMMON_PIPELINE_HPP
+#define COMMON_PIPELINE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "parallel.hpp"
+
+namespace pipeline {
+
+///
+/// @brief A reusable buffer travelling through the pipeline.
+///
+struct Block {
+    std::vector<std::byte> data;        ///< storage, reused from one block to the next
+    std::size_t size {0};               ///< bytes of `data` in use
+    std::size_t index {0};              ///< position of the block in the stream
+    std::size_t input_size {0};         ///< for an output block, `size` of the input block it was made from
+};
+
+///
+/// @brief Bounded lock-free queue for one producer thread and one consumer thread.
+/// @tparam T   type of the elements, which must be cheap to copy
+///
+template <typename T>
+class SpscRing {
+public:
+
+    explicit SpscRing(std::size_t capacity):
+        slots(capacity + 1)
+    {
+    }
+
+    ///
+    /// @brief Appends `v`, unless the ring is full.
+    /// @returns whether `v` was appended
+    ///
+    bool try_push(const T &v)
+    {
+        const std::size_t t {tail.load(std::memory_order_relaxed)};
+        const std::size_t n {t + 1 == slots.size() ? 0 : t + 1};
+
+        if (n == head.load(std::memory_order_acquire))
+            return false;
+
+        slots[t] = v;
+        tail.store(n, std::memory_order_release);
+        return true;
+    }
+
+    ///
+    /// @brief Removes the oldest element into `v`, unless the ring is empty.
+    /// @returns whether an element was removed
+    ///
+    bool try_pop(T &v)
+    {
+        const std::size_t h {head.load(std::memory_order_relaxed)};
+
+        if (h == tail.load(std::memory_order_acquire))
+            return false;
+
+        v = slots[h];
+        head.store(h + 1 == slots.size() ? 0 : h + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+
+    std::vector<T> slots;                   ///< one slot is always free, to tell full from empty
+
+    // each index is written by one side only; keeping them apart avoids false sharing
+    alignas(64) std::atomic<std::size_t> head {0};
+    alignas(64) std::atomic<std::size_t> tail {0};
+};
+
+namespace detail {
+
+///
+/// @brief Waits until `f()` succeeds or `stop` is set.
+/// @returns false if the wait was cut short by `stop`
+///
+template <typename F>
+bool wait_for(F f, const std::atomic<bool> &stop)
+{
+    for (unsigned tries = 0; !f(); ++tries)
+    {
+        if (stop.load(std::memory_order_relaxed))
+            return false;
+
+        // the other stages are busy for a whole block, which takes far longer
+        // than a short sleep; spinning or yielding instead would take the
+        // processor away from them when there are fewer cores than threads
+        if (tries < 16)
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+
+    return true;
+}
+
+} // namespace detail
+
+///
+/// @brief Runs `read`, `process` and `write` as a pipeline until `read` runs out of blocks.
+/// @param workers      threads running `process`
+/// @param depth        blocks that may wait between two stages
+/// @param read         callable `(Block &in)`: fills `in` and returns true, or returns false at the end
+/// @param process      callable `(unsigned worker, Block &in, Block &out)`: fills `out` from `in`
+/// @param write        callable `(Block &out)`: stores `out`; called in the order the blocks were read
+///
+/// `read` runs on its own thread, `write` on another, and `process` on
+/// `workers` threads, each with its own `worker` index. The first exception
+/// thrown by any stage stops the pipeline, and is rethrown once all the
+/// threads are done.
+///
+template <typename Read, typename Process, typename Write>
+void run(unsigned workers, std::size_t depth, Read read, Process process, Write write)
+{
+    if (workers == 0)
+        workers = 1;
+
+    // every worker can hold a block while `depth` blocks wait in the rings
+    const std::size_t blocks {depth + workers};
+
+    std::vector<Block> inputs(blocks);
+    std::vector<Block> outputs(blocks);
+
+    // the end of the stream travels as a null block
+    SpscRing<Block *> free_inputs(blocks);
+    SpscRing<Block *> read_blocks(blocks + 1);
+    SpscRing<Block *> free_outputs(blocks);
+    SpscRing<Block *> done_blocks(blocks + 1);
+
+    // the workers take blocks one at a time, in the order they were read
+    std::mutex take;
+    bool read_all {false};
+
+    // finished blocks by `index % blocks`: no more than `blocks` are ever out
+    // of their pool, so those waiting for an earlier one never share a slot
+    std::mutex finish;
+    std::vector<Block *> finished(blocks, nullptr);
+    std::size_t next_done {0};
+
+    std::atomic<bool> stop {false};
+    std::mutex m;
+    std::exception_ptr error;
+
+    const auto fail = [&] {
+        std::lock_guard<std::mutex> lock(m);
+
+        if (!error)
+            error = std::current_exception();
+
+        stop = true;
+    };
+
+    for (std::size_t b = 0; b < blocks; ++b)
+    {
+        free_inputs.try_push(&inputs[b]);
+        free_outputs.try_push(&outputs[b]);
+    }
+
+    std::thread reader([&] {
+        try
+        {
+            for (std::size_t index = 0;; ++index)
+            {
+                Block *in;
+
+                if (!detail::wait_for([&] { return free_inputs.try_pop(in); }, stop))
+                    return;
+
+                in->index = index;
+
+                if (!read(*in))
+                    in = nullptr;
+
+                if (!detail::wait_for([&] { return read_blocks.try_push(in); }, stop) || in == nullptr)
+                    return;
+            }
+        }
+        catch (...)
+        {
+            fail();
+        }
+    });
+
+    std::thread writer([&] {
+        try
+        {
+            for (;;)
+            {
+                Block *out;
+
+                if (!detail::wait_for([&] { return done_blocks.try_pop(out); }, stop) || out == nullptr)
+                    return;
+
+                write(*out);
+                detail::wait_for([&] { return free_outputs.try_push(out); }, stop);
+            }
+        }
+        catch (...)
+        {
+            fail();
+        }
+    });
+
+    const auto worker_loop = [&](unsigned w) {
+        try
+        {
+            for (;;)
+            {
+                Block *in;
+                Block *out;
+
+                {
+                    std::lock_guard<std::mutex> lock(take);
+
+                    if (read_all || !detail::wait_for([&] { return read_blocks.try_pop(in); }, stop))
+                        return;
+
+                    if (in == nullptr)
+                    {
+                        read_all = true;
+                        return;
+                    }
+
+                    // taking the output block along with the input one means
+                    // that the earliest unfinished block always has one
+                    if (!detail::wait_for([&] { return free_outputs.try_pop(out); }, stop))
+                        return;
+                }
+
+                out->index = in->index;
+                out->input_size = in->size;
+                process(w, *in, *out);
+
+                std::lock_guard<std::mutex> lock(finish);
+
+                // neither ring can be full: each has room for every block of its pool
+                free_inputs.try_push(in);
+                finished[out->index % blocks] = out;
+
+                for (; finished[next_done % blocks] != nullptr; ++next_done)
+                {
+                    done_blocks.try_push(finished[next_done % blocks]);
+                    finished[next_done % blocks] = nullptr;
+                }
+            }
+        }
+        catch (...)
+        {
+            fail();
+        }
+    };
+
+    std::vector<std::thread> threads;
+
+    for (unsigned w = 0; w < workers; ++w)
+        threads.emplace_back(worker_loop, w);
+
+    for (std::thread &t : threads)
+        t.join();
+
+    // every block has gone to the writer by now, unless the pipeline stopped
+    done_blocks.try_push(nullptr);
+
+    reader.join();
+    writer.join();
+
+    if (error)
+        std::rethrow_exception(error);
+}
+
+} // namespace pipeline
+
+#endif // COMMON_PIPELINE_HPP
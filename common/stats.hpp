@@ -0,0 +1,264 @@
+///
+/// @file
+/// @brief Optional per-phase timers and counters for both codecs.
+///
+/// The instrumentation is only compiled in when `CODEC_STATS` is defined (for
+/// instance with `-DCODEC_STATS`). Otherwise `Timer` and `add()` are empty and
+/// the compiler removes them, so the codecs can call them on their hot paths.
+///
+/// Every thread accumulates into its own counters, which are merged into the
+/// global ones when the thread ends. `collect()` therefore sees the work of the
+/// calling thread and of every worker thread that has already finished, which
+/// is the case once a call to the codecs returns. The time of a phase is summed
+/// over the threads that ran it, so with several workers it can exceed the
+/// elapsed time. Phases nest: while an inner phase runs, the outer one is
+/// paused, so no time is counted twice.
+///
+
+#ifndef COMMON_STATS_HPP
+#define COMMON_STATS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+namespace stats {
+
+#ifdef CODEC_STATS
+inline constexpr bool enabled {true};
+#else
+inline constexpr bool enabled {false};
+#endif
+
+/// Phases of compression and decompression.
+enum Phase: unsigned {
+    read,           ///< loading the input
+    count,          ///< counting symbol frequencies
+    build,          ///< computing code lengths and codes
+    table,          ///< writing, reading or building coding tables
+    encode,         ///< producing the compressed stream
+    decode,         ///< reproducing the original data
+    write,          ///< storing the output
+    phase_count
+};
+
+/// Events counted by the codecs.
+enum Counter: unsigned {
+    bytes_in,       ///< bytes given to a codec
+    bytes_out,      ///< bytes produced by a codec
+    resets,         ///< LZW dictionary resets
+    codes,          ///< LZW codes written or read
+    symbols,        ///< symbols coded with a Huffman table
+    bits,           ///< bits of those symbols, including any extra bits
+    table_misses,   ///< Huffman symbols decoded through a second-level table
+    allocations,    ///< calls to `operator new`, when counted (see `STATS_COUNT_ALLOCATIONS`)
+    counter_count
+};
+
+///
+/// @brief Totals of every phase and counter.
+///
+struct Report {
+    std::uint64_t nanoseconds[phase_count] {};
+    std::uint64_t values[counter_count] {};
+};
+
+class Timer;
+
+namespace detail {
+
+/// Totals of the threads that have finished or flushed their counters.
+struct Totals {
+    std::atomic<std::uint64_t> nanoseconds[phase_count] {};
+    std::atomic<std::uint64_t> values[counter_count] {};
+};
+
+inline Totals totals;
+
+/// Counters of one thread, added to `totals` when it ends.
+struct Local {
+    Report report;
+    Timer *active {nullptr};    ///< innermost running timer
+
+    void flush()
+    {
+        for (unsigned p = 0; p < phase_count; ++p)
+            totals.nanoseconds[p].fetch_add(report.nanoseconds[p], std::memory_order_relaxed);
+
+        for (unsigned c = 0; c < counter_count; ++c)
+            totals.values[c].fetch_add(report.values[c], std::memory_order_relaxed);
+
+        report = Report {};
+    }
+
+    ~Local()
+    {
+        flush();
+    }
+};
+
+inline thread_local Local local;
+
+/// Calls to `operator new`, counted apart since they can happen while a thread's `Local` is gone.
+inline std::atomic<std::uint64_t> allocations_made {0};
+
+} // namespace detail
+
+///
+/// @brief Adds `n` to `counter`.
+///
+inline void add([[maybe_unused]] Counter counter, [[maybe_unused]] std::uint64_t n)
+{
+    if constexpr (enabled)
+        detail::local.report.values[counter] += n;
+}
+
+///
+/// @brief Adds the time until the end of its scope to a phase.
+///
+class Timer {
+public:
+
+    explicit Timer([[maybe_unused]] Phase phase)
+    {
+        if constexpr (enabled)
+        {
+            detail::Local &l = detail::local;
+
+            this->phase = phase;
+            start = std::chrono::steady_clock::now();
+            parent = l.active;
+            l.active = this;
+
+            if (parent != nullptr)
+                parent->charge(start);
+        }
+    }
+
+    Timer(const Timer &) = delete;
+    Timer &operator=(const Timer &) = delete;
+
+    ~Timer()
+    {
+        if constexpr (enabled)
+        {
+            const auto now = std::chrono::steady_clock::now();
+
+            charge(now);
+            detail::local.active = parent;
+
+            if (parent != nullptr)
+                parent->start = now;
+        }
+    }
+
+private:
+
+    /// Adds the time since `start` to the phase.
+    void charge(std::chrono::steady_clock::time_point now)
+    {
+        detail::local.report.nanoseconds[phase] +=
+            std::chrono::duration_cast<std::chrono::nanoseconds> (now - start).count();
+    }
+
+    Phase phase {read};
+    std::chrono::steady_clock::time_point start;
+    Timer *parent {nullptr};
+};
+
+///
+/// @brief Totals of the calling thread and of every finished thread.
+///
+inline Report collect()
+{
+    Report r;
+
+    detail::local.flush();
+
+    for (unsigned p = 0; p < phase_count; ++p)
+        r.nanoseconds[p] = detail::totals.nanoseconds[p].load(std::memory_order_relaxed);
+
+    for (unsigned c = 0; c < counter_count; ++c)
+        r.values[c] = detail::totals.values[c].load(std::memory_order_relaxed);
+
+    r.values[allocations] += detail::allocations_made.load(std::memory_order_relaxed);
+    return r;
+}
+
+///
+/// @brief Sets every phase and counter back to zero.
+///
+inline void reset()
+{
+    detail::local.report = Report {};
+
+    for (auto &n : detail::totals.nanoseconds)
+        n.store(0, std::memory_order_relaxed);
+
+    for (auto &v : detail::totals.values)
+        v.store(0, std::memory_order_relaxed);
+
+    detail::allocations_made.store(0, std::memory_order_relaxed);
+}
+
+///
+/// @brief Writes `r` to `f` in a human-readable form.
+///
+inline void print(std::FILE *f, const Report &r)
+{
+    static const char *const phase_names[phase_count] {"read", "count", "build", "table", "encode", "decode", "write"};
+    static const char *const counter_names[counter_count] {"bytes in", "bytes out", "dictionary resets",
+        "codes", "symbols", "bits", "table misses", "allocations"};
+
+    std::fprintf(f, "phase            ms\n");
+
+    for (unsigned p = 0; p < phase_count; ++p)
+        if (r.nanoseconds[p] != 0)
+            std::fprintf(f, "%-12s %9.3f\n", phase_names[p], r.nanoseconds[p] / 1e6);
+
+    std::fprintf(f, "counter                   value\n");
+
+    for (unsigned c = 0; c < counter_count; ++c)
+        if (r.values[c] != 0)
+            std::fprintf(f, "%-18s %12llu\n", counter_names[c], static_cast<unsigned long long> (r.values[c]));
+
+    if (r.values[symbols] != 0)
+        std::fprintf(f, "%-18s %12.3f\n", "bits per symbol", static_cast<double> (r.values[bits]) / r.values[symbols]);
+}
+
+} // namespace stats
+
+///
+/// @brief Replaces `operator new` so that `stats::allocations` counts every allocation.
+///
+/// A replacement must be defined exactly once per program, so a program that
+/// wants its allocations counted expands this macro once, at namespace scope in
+/// one of its source files. The replacements are kept out of line: inlined,
+/// the compiler would see `malloc()` paired with `operator delete` and warn
+/// about a mismatch.
+///
+#if defined(CODEC_STATS) && defined(__GNUC__)
+#define STATS_OUT_OF_LINE __attribute__((noinline))
+#else
+#define STATS_OUT_OF_LINE
+#endif
+
+#ifdef CODEC_STATS
+#define STATS_COUNT_ALLOCATIONS() \
+    STATS_OUT_OF_LINE void *operator new(std::size_t n) \
+    { \
+        stats::detail::allocations_made.fetch_add(1, std::memory_order_relaxed); \
+        if (void *p = std::malloc(n != 0 ? n : 1)) \
+            return p; \
+        throw std::bad_alloc(); \
+    } \
+    STATS_OUT_OF_LINE void operator delete(void *p) noexcept { std::free(p); } \
+    STATS_OUT_OF_LINE void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+#else
+#define STATS_COUNT_ALLOCATIONS()
+#endif
+
+#endif // COMMON_STATS_HPP
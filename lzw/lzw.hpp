@@ -0,0 +1,2258 @@
+///
+/// @file
+/// @brief Header-only LZW codec working on contiguous buffers.
+///
+/// Every codec reads a `std::span<const std::byte>` and writes to an `lzw::Output`,
+/// which either appends to an `std::vector<std::byte>` that grows as needed, or
+/// fills a `std::span<std::byte>` provided by the caller. Input can therefore come
+/// straight from memory-mapped files or network buffers, without going through
+/// streams. Requires C++20.
+///
+/// These formats are supported:
+/// - the original fixed-width format, a plain sequence of 16-bit codes;
+/// - the variable-width format, whose codes grow from 9 bits up to a maximum;
+/// - the parallel format, which splits the variable-width codes into chunks
+///   that are compressed and decompressed independently;
+/// - the hybrid format, which entropy-codes the variable-width codes with the
+///   canonical Huffman coder of `MCompres/huffman.h`;
+/// - the primed format, for small messages, whose variable-width codes start
+///   from a dictionary primed with a trained sample (`common/dictionary.hpp`).
+/// - the stream format, for data that is compressed as it arrives, whose
+///   variable-width codes can be flushed at any point so that the decoder
+///   catches up with everything written so far, without losing the dictionary.
+///
+/// The free functions build their dictionaries on every call. Code that
+/// compresses many inputs should keep an `lzw::Compressor` and an
+/// `lzw::Decompressor` per thread instead, which build them once.
+///
+
+#ifndef LZW_HPP
+#define LZW_HPP
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "../common/dictionary.hpp"
+#include "../common/parallel.hpp"
+#include "../common/stats.hpp"
+#include "../MCompres/huffman.h"
+
+namespace lzw {
+
+/// Type used to store and retrieve codes in the fixed-width format.
+using CodeType = std::uint16_t;
+
+namespace globals {
+
+/// Dictionary Maximum Size (when reached, the dictionary will be reset)
+const CodeType dms {std::numeric_limits<CodeType>::max()};
+
+/// Code that tells the decoder to reset its dictionary, in the variable-width format.
+const CodeType clear_code {256};
+
+/// First code assigned to a multi-byte string, in the variable-width format.
+const CodeType first_free_code {257};
+
+/// Width of the codes right after a reset, in the variable-width format.
+const unsigned min_width {9};
+
+/// Largest code width of the variable-width format.
+const unsigned max_width {24};
+
+/// Default code width of the variable-width format.
+const unsigned default_width {16};
+
+/// Input bytes between two checks of the compression ratio, once the dictionary is full.
+const std::uint64_t check_gap {10000};
+
+/// Version of the parallel format, which uses the same magic bytes.
+const char parallel_version {3};
+
+/// Bytes of input compressed independently of the others, in the parallel format.
+const std::uint32_t chunk_size {4 * 1024 * 1024};
+
+/// Bytes per chunk in the table at the end of a parallel file: compressed and original sizes.
+const std::size_t table_entry_size {8};
+
+/// Flag in the original size of a chunk that is stored as it is, because its codes would not be smaller.
+const std::uint32_t stored_chunk {0x80000000};
+
+/// Magic bytes at the start of a variable-width file, followed by the format version and the maximum width.
+const char magic[3] {'L', 'Z', 'W'};
+
+/// Version of the variable-width format.
+const char format_version {2};
+
+/// Size of the header of a variable-width file.
+const std::size_t header_size {sizeof magic + 2};
+
+/// Size of the header of a parallel file, which adds the chunk size.
+const std::size_t parallel_header_size {sizeof magic + 6};
+
+/// Version of the hybrid format, which uses the same magic bytes and header as the variable-width one.
+const char hybrid_version {4};
+
+/// Huffman symbols of the hybrid format: one per single byte, the clear code, and
+/// two per width of the larger codes, split by the bit below the leading one.
+const unsigned hybrid_symbols {first_free_code + 2 * (max_width - min_width + 1)};
+
+/// Codes per block of the hybrid format; each block has its own Huffman table.
+const std::size_t hybrid_block_codes {64 * 1024};
+
+/// Version of the primed format, which uses the same magic bytes.
+const char primed_version {5};
+
+/// Size of the header of a primed message, which adds the ID of its dictionary.
+const std::size_t primed_header_size {sizeof magic + 6};
+
+/// Version of the stream format, which uses the same magic bytes and header as the variable-width one.
+const char stream_version {6};
+
+/// Code that marks a flush point in the stream format; the bit stream is padded to a whole byte after it.
+const CodeType flush_code {257};
+
+/// First code assigned to a multi-byte string, in the stream format.
+const CodeType stream_first_code {258};
+
+} // namespace globals
+
+///
+/// @brief Destination of a codec: a growable buffer or a fixed span provided by the caller.
+///
+/// Both constructors are implicit, so either kind of buffer can be passed directly
+/// to the codec functions.
+///
+class Output {
+public:
+
+    ///
+    /// @brief Appends to `v`, which grows as needed.
+    ///
+    Output(std::vector<std::byte> &v):
+        growable(&v),
+        start(v.size()),
+        used(v.size())
+    {
+        v.resize(v.capacity());
+        data = v.data();
+        capacity = v.size();
+    }
+
+    ///
+    /// @brief Writes to `s`; running out of room throws `std::length_error`.
+    ///
+    Output(std::span<std::byte> s):
+        data(s.data()),
+        capacity(s.size())
+    {
+    }
+
+    ///
+    /// @brief Takes over the buffer of `o`, so that a function can pass its output on to another.
+    ///
+    Output(Output &&o):
+        growable(std::exchange(o.growable, nullptr)),
+        data(o.data),
+        capacity(o.capacity),
+        start(o.start),
+        used(o.used)
+    {
+    }
+
+    Output(const Output &) = delete;
+    Output &operator=(const Output &) = delete;
+
+    ~Output()
+    {
+        if (growable != nullptr)
+            growable->resize(used);
+    }
+
+    ///
+    /// @brief Makes room for `n` more bytes.
+    /// @returns where the `n` bytes must be stored
+    ///
+    std::byte *reserve(std::size_t n)
+    {
+        if (capacity - used < n)
+            grow(n);
+
+        std::byte *p {data + used};
+
+        used += n;
+        return p;
+    }
+
+    ///
+    /// @brief Appends the byte `b`.
+    ///
+    void put(std::byte b)
+    {
+        if (used == capacity)
+            grow(1);
+
+        data[used++] = b;
+    }
+
+    ///
+    /// @brief Appends `n` bytes from `p`.
+    ///
+    void write(const void *p, std::size_t n)
+    {
+        if (n != 0)
+            std::memcpy(reserve(n), p, n);
+    }
+
+    ///
+    /// @brief Number of bytes written so far.
+    ///
+    std::size_t size() const
+    {
+        return used - start;
+    }
+
+private:
+
+    void grow(std::size_t n)
+    {
+        if (growable == nullptr)
+            throw std::length_error("output buffer is too small");
+
+        growable->resize(std::max({2 * capacity, used + n, std::size_t {64 * 1024}}));
+        data = growable->data();
+        capacity = growable->size();
+    }
+
+    std::vector<std::byte> *growable {nullptr};
+    std::byte *data;
+    std::size_t capacity;
+    std::size_t start {0};      ///< bytes already in the vector before the codec ran
+    std::size_t used {0};
+};
+
+///
+/// @brief Number of bits needed to write `x`.
+///
+inline unsigned bit_length(std::uint32_t x)
+{
+    return std::bit_width(x);
+}
+
+///
+/// @brief Code of the single-byte string `b`.
+///
+template <typename Code>
+inline Code code_of(std::byte b)
+{
+    return static_cast<Code> (static_cast<char> (b) - std::numeric_limits<char>::min());
+}
+
+///
+/// @brief Writes `x` to `p` as four little-endian bytes.
+///
+inline void put_u32(std::byte *p, std::uint32_t x)
+{
+    for (int b = 0; b < 4; ++b)
+        p[b] = static_cast<std::byte> (x >> 8 * b);
+}
+
+///
+/// @brief Reads four little-endian bytes from `p`.
+///
+inline std::uint32_t get_u32(const std::byte *p)
+{
+    std::uint32_t x {0};
+
+    for (int b = 3; b >= 0; --b)
+        x = x << 8 | std::to_integer<std::uint32_t> (p[b]);
+
+    return x;
+}
+
+///
+/// @brief Bits that a `BitWriter` or a `BitReader` carries over from one buffer of a stream to the next.
+///
+struct PendingBits {
+    std::uint64_t bits {0};     ///< the bits, in the low `count` bits
+    unsigned count {0};
+};
+
+///
+/// @brief Packs codes of varying width into an `Output`, most significant bit first.
+///
+class BitWriter {
+public:
+
+    ///
+    /// @param pending  bits that the writer of the previous buffer of the stream left unwritten
+    ///
+    explicit BitWriter(Output &out, PendingBits pending = {}):
+        out(out),
+        bits(pending.bits),
+        count(pending.count)
+    {
+    }
+
+    ///
+    /// @brief Appends the low `width` bits of `code`.
+    ///
+    void put(std::uint32_t code, unsigned width)
+    {
+        bits = bits << width | code;
+        count += width;
+
+        while (count >= 8)
+        {
+            count -= 8;
+            out.put(static_cast<std::byte> (bits >> count));
+        }
+    }
+
+    ///
+    /// @brief Pads the last byte with zero bits.
+    ///
+    void flush()
+    {
+        if (count != 0)
+            out.put(static_cast<std::byte> (bits << (8 - count)));
+
+        count = 0;
+    }
+
+    ///
+    /// @brief Bits not yet written, fewer than 8, for the writer of the next buffer.
+    ///
+    PendingBits pending() const
+    {
+        return {bits, count};
+    }
+
+private:
+
+    Output &out;
+    std::uint64_t bits {0};     ///< pending bits, in the low `count` bits
+    unsigned count {0};
+};
+
+///
+/// @brief Reads the codes written by `BitWriter` back from a buffer.
+///
+class BitReader {
+public:
+
+    ///
+    /// @param pending  bits that the reader of the previous buffer of the stream left unread
+    ///
+    explicit BitReader(std::span<const std::byte> in, PendingBits pending = {}):
+        in(in),
+        bits(pending.bits),
+        count(pending.count)
+    {
+    }
+
+    ///
+    /// @brief Reads the next `width` bits into `code`.
+    /// @returns false if fewer than `width` bits are left, which is the padding at the end
+    ///
+    template <typename Code>
+    bool get(Code &code, unsigned width)
+    {
+        while (count < width)
+        {
+            if (position == in.size())
+                return false;
+
+            bits = bits << 8 | std::to_integer<std::uint64_t> (in[position++]);
+            count += 8;
+        }
+
+        count -= width;
+        code = static_cast<Code> ((bits >> count) & ((std::uint64_t {1} << width) - 1));
+        return true;
+    }
+
+    ///
+    /// @brief Skips the padding up to the next whole byte.
+    ///
+    void align()
+    {
+        count -= count % 8;
+    }
+
+    ///
+    /// @brief Bits not yet read, for the reader of the next buffer.
+    ///
+    /// After `get()` fails, they include the start of the code it could not read.
+    ///
+    PendingBits pending() const
+    {
+        return {bits, count};
+    }
+
+private:
+
+    std::span<const std::byte> in;
+    std::size_t position {0};
+    std::uint64_t bits {0};     ///< unread bits, in the low `count` bits
+    unsigned count {0};
+};
+
+///
+/// @brief Entropy-codes LZW codes in blocks, each with its own canonical Huffman table.
+///
+/// A code below `globals::first_free_code` is a symbol of its own. Larger codes
+/// are grouped by their width and the bit below the leading one, and the rest of
+/// their bits follow the symbol as they are. Every block is written as the number
+/// of codes, its mode, the table of code lengths (Huffman blocks only), the size
+/// of the bit stream and the bit stream itself.
+///
+/// When the codes of a block are close to uniform, as with text once the
+/// dictionary is full, Huffman coding can cost more than the code widths it
+/// replaces; such blocks are packed as in the variable-width format instead.
+///
+class HuffmanWriter {
+public:
+
+    /// Ways of coding a block.
+    enum Mode: unsigned char {
+        packed,                             ///< every code with its width, as `BitWriter` does
+        huffman                             ///< Huffman symbols followed by extra bits
+    };
+
+    explicit HuffmanWriter(Output &out):
+        out(out)
+    {
+        codes.reserve(globals::hybrid_block_codes);
+    }
+
+    ///
+    /// @brief Appends `code`, which the variable-width format would write with `width` bits.
+    ///
+    void put(std::uint32_t code, unsigned width)
+    {
+        codes.push_back(width << width_shift | code);
+
+        if (codes.size() == globals::hybrid_block_codes)
+            write_block();
+    }
+
+    ///
+    /// @brief Writes the codes of the last, partial block.
+    ///
+    void flush()
+    {
+        if (!codes.empty())
+            write_block();
+    }
+
+    ///
+    /// @brief Huffman symbol of `code`.
+    /// @param [out] extra  number of low bits of `code` that follow the symbol
+    ///
+    static unsigned symbol_of(std::uint32_t code, unsigned &extra)
+    {
+        if (code < globals::first_free_code)
+        {
+            extra = 0;
+            return code;
+        }
+
+        const unsigned width {bit_length(code)};
+
+        extra = width - 2;
+        return globals::first_free_code + 2 * (width - globals::min_width) + (code >> extra & 1);
+    }
+
+    /// Size of the block header: number of codes and mode.
+    static const std::size_t block_header_size {5};
+
+private:
+
+    void write_block()
+    {
+        unsigned long int frequency[globals::hybrid_symbols] {};
+        unsigned char length[globals::hybrid_symbols];
+        std::uint64_t packed_bits {0};
+        std::uint64_t huffman_bits {0};
+        unsigned extra;
+
+        {
+            stats::Timer t(stats::count);
+
+            for (const std::uint32_t c : codes)
+            {
+                ++frequency[symbol_of(c & code_mask, extra)];
+                huffman_bits += extra;
+                packed_bits += c >> width_shift;
+            }
+        }
+
+        {
+            stats::Timer t(stats::build);
+
+            LongitudesHuffman(frequency, globals::hybrid_symbols, MAX_BITS_HUFFMAN, length, &scratch);
+
+            for (unsigned s = 0; s < globals::hybrid_symbols; ++s)
+                huffman_bits += static_cast<std::uint64_t> (frequency[s]) * length[s];
+        }
+
+        // room for the worst case, the longest symbol and extra bits for every code,
+        // plus the margin that the bit writer needs
+        block.resize(block_header_size + TAM_MAX_TABLA(globals::hybrid_symbols) + 4
+            + codes.size() * (MAX_BITS_HUFFMAN + globals::max_width - 2) / 8 + 16);
+
+        std::uint8_t *const start {reinterpret_cast<std::uint8_t *> (block.data())};
+        const std::size_t table_size {EscribirLongitudes(start + block_header_size, length, globals::hybrid_symbols)};
+        std::size_t size;
+
+        put_u32(block.data(), static_cast<std::uint32_t> (codes.size()));
+
+        if (8 * table_size + huffman_bits < packed_bits)
+        {
+            std::uint8_t *const stream {start + block_header_size + table_size + 4};
+            tipoCodigo table[globals::hybrid_symbols];
+            tipoEscritor writer;
+
+            CrearTablaCodigos(length, globals::hybrid_symbols, table);
+
+            // after each flush at most 7 bits are pending, so a symbol and its extra bits always fit
+            IniciarEscritor(&writer, stream);
+
+            for (const std::uint32_t c : codes)
+            {
+                const std::uint32_t code {c & code_mask};
+                const unsigned s {symbol_of(code, extra)};
+
+                PonerBits(&writer, table[s].bits, table[s].nbits);
+
+                if (extra != 0)
+                    PonerBits(&writer, code & ((1u << extra) - 1), extra);
+
+                VaciarBits(&writer);
+            }
+
+            TerminarBits(&writer);
+
+            block[4] = static_cast<std::byte> (huffman);
+            put_u32(&block[block_header_size + table_size], static_cast<std::uint32_t> (writer.p - stream));
+            size = writer.p - start;
+            stats::add(stats::symbols, codes.size());
+            stats::add(stats::bits, huffman_bits);
+        }
+        else
+        {
+            Output block_out(std::span<std::byte> (block).subspan(block_header_size + 4));
+            BitWriter writer(block_out);
+
+            for (const std::uint32_t c : codes)
+                writer.put(c & code_mask, c >> width_shift);
+
+            writer.flush();
+
+            block[4] = static_cast<std::byte> (packed);
+            put_u32(&block[block_header_size], static_cast<std::uint32_t> (block_out.size()));
+            size = block_header_size + 4 + block_out.size();
+        }
+
+        out.write(block.data(), size);
+        codes.clear();
+    }
+
+    /// Every entry of `codes` keeps the width of the code above the code itself.
+    static const unsigned width_shift {globals::max_width};
+    static const std::uint32_t code_mask {(1u << width_shift) - 1};
+
+    Output &out;
+    std::vector<std::uint32_t> codes;       ///< codes of the current block
+    std::vector<std::byte> block;           ///< the block being encoded, reused from one to the next
+    tipoPaquetes scratch;                   ///< working memory of the code lengths, also reused
+};
+
+///
+/// @brief Reads the codes written by `HuffmanWriter` back from a buffer.
+///
+class HuffmanReader {
+public:
+
+    explicit HuffmanReader(std::span<const std::byte> in):
+        in(in),
+        table(std::make_unique<tipoTablaDecodificacion>())
+    {
+        IniciarLector(&reader, nullptr, nullptr);
+    }
+
+    ///
+    /// @brief Reads the next code into `code`, checking that it fits in `width` bits.
+    /// @returns false at the end of the input
+    ///
+    template <typename Code>
+    bool get(Code &code, unsigned width)
+    {
+        if (left == 0 && !next_block())
+            return false;
+
+        --left;
+
+        if (mode == HuffmanWriter::packed)
+        {
+            if (!packed.get(code, width))
+                throw std::runtime_error("corrupted compressed file");
+
+            return true;
+        }
+
+        // a reload leaves at least 56 bits: enough for a symbol and its extra bits
+        RecargarBits(&reader);
+
+        const unsigned s {DecodificarSimbolo(&reader, table->entradas)};
+        std::uint32_t value {s};
+
+        if (s >= globals::first_free_code)
+        {
+            const unsigned bucket {s - globals::first_free_code};
+            const unsigned extra {bucket / 2 + globals::min_width - 2};
+
+            value = (2 | (bucket & 1)) << extra | static_cast<std::uint32_t> (reader.bits >> (64 - extra));
+            reader.bits <<= extra;
+            reader.nbits -= extra;
+        }
+
+        if (value >> width != 0)
+            throw std::runtime_error("invalid compressed code");
+
+        code = static_cast<Code> (value);
+        return true;
+    }
+
+private:
+
+    ///
+    /// @brief Reads the header and table of the next block.
+    /// @returns false if there are no more blocks
+    ///
+    bool next_block()
+    {
+        if (LectorAgotado(&reader))
+            throw std::runtime_error("corrupted compressed file");
+
+        if (position == in.size())
+            return false;
+
+        const std::uint8_t *const p {reinterpret_cast<const std::uint8_t *> (in.data()) + position};
+        std::size_t available {in.size() - position};
+        std::size_t table_size {0};
+
+        if (available < HuffmanWriter::block_header_size + 4)
+            throw std::runtime_error("corrupted compressed file");
+
+        left = get_u32(in.data() + position);
+        mode = p[4];
+
+        if (left == 0 || mode > HuffmanWriter::huffman)
+            throw std::runtime_error("corrupted compressed file");
+
+        if (mode == HuffmanWriter::huffman)
+        {
+            stats::Timer t(stats::table);
+            unsigned char length[globals::hybrid_symbols];
+            const long n {LeerLongitudes(p + HuffmanWriter::block_header_size,
+                available - HuffmanWriter::block_header_size, length, globals::hybrid_symbols)};
+
+            if (n < 0 || available - HuffmanWriter::block_header_size - n < 4)
+                throw std::runtime_error("corrupted compressed file");
+
+            table_size = n;
+            CrearTablaDecodificacion(length, globals::hybrid_symbols, table.get());
+        }
+
+        const std::byte *const stream {in.data() + position + HuffmanWriter::block_header_size + table_size + 4};
+        const std::uint32_t stream_size {get_u32(stream - 4)};
+
+        available -= HuffmanWriter::block_header_size + table_size + 4;
+
+        if (stream_size > available)
+            throw std::runtime_error("corrupted compressed file");
+
+        if (mode == HuffmanWriter::huffman)
+        {
+            IniciarLector(&reader, reinterpret_cast<const std::uint8_t *> (stream),
+                reinterpret_cast<const std::uint8_t *> (stream) + stream_size);
+            stats::add(stats::symbols, left);
+            stats::add(stats::bits, 8 * static_cast<std::uint64_t> (stream_size));
+        }
+        else
+            packed = BitReader(std::span<const std::byte> (stream, stream_size));
+
+        position = stream + stream_size - in.data();
+        return true;
+    }
+
+    std::span<const std::byte> in;
+    std::size_t position {0};               ///< start of the next block
+    std::uint32_t left {0};                 ///< codes left in the current block
+    unsigned mode {HuffmanWriter::huffman};
+    std::unique_ptr<tipoTablaDecodificacion> table;
+    tipoLector reader;                      ///< bit stream of a Huffman block
+    BitReader packed {{}};                  ///< bit stream of a packed block
+};
+
+///
+/// @brief Dictionary used by the compressors, stored as an open-addressing hash table.
+/// @tparam Code    type that holds a code
+///
+/// Every entry maps a (prefix code, byte) pair to a code. The single-byte strings
+/// are not stored: their codes follow from the byte itself. A slot is in use only
+/// if its generation matches the current one, so `reset()` just bumps the generation
+/// instead of clearing the table. The strings added by `prime()` have a generation
+/// of their own, which no reset removes.
+///
+template <typename Code>
+class EncoderDictionary {
+public:
+
+    ///
+    /// @param first_code   code assigned to the first multi-byte string
+    /// @param width        width of the largest code, which sets the dictionary's capacity
+    ///
+    explicit EncoderDictionary(std::size_t first_code = single_codes,
+        unsigned width = std::numeric_limits<Code>::digits):
+        limit(std::size_t {1} << width),
+        first_code(first_code),
+        table_bits(width + 1),
+        slots(std::size_t {1} << table_bits)
+    {
+        reset();
+    }
+
+    ///
+    /// @brief Removes every multi-byte string from the dictionary.
+    ///
+    void reset()
+    {
+        // once the generation wraps around, stale slots could look live
+        // again, so they are really cleared, all but the primed ones
+        if (++generation == permanent)
+        {
+            for (Slot &s : slots)
+                if (s.value >> code_bits != permanent)
+                    s = Slot {};
+
+            generation = 1;
+        }
+
+        size = first_code;
+    }
+
+    ///
+    /// @brief Adds for good the strings that compressing `sample` would add.
+    ///
+    /// From then on `reset()` goes back to these strings rather than to an
+    /// empty dictionary. Only half of the codes are used, so that the data
+    /// still has room for strings of its own. Must be called before the
+    /// dictionary is used.
+    ///
+    void prime(std::span<const std::byte> sample)
+    {
+        const std::uint32_t current {generation};
+        Code i;
+
+        generation = permanent;
+
+        for (std::size_t p = 0; p < sample.size() && size < limit / 2; ++p)
+            if (p == 0 || !find_or_add(i, sample[p], i))
+                i = code_of<Code>(sample[p]);
+
+        generation = current;
+        first_code = size;
+    }
+
+    ///
+    /// @brief Looks up the string `i` + `c`; if it is missing, adds it with the next free code.
+    /// @param i            code of the prefix
+    /// @param c            byte that follows the prefix
+    /// @param [out] code   code of the string, if it was found
+    /// @returns whether the string was already in the dictionary
+    ///
+    /// Nothing is added once all the codes are taken.
+    ///
+    bool find_or_add(Code i, std::byte c, Code &code)
+    {
+        const std::uint32_t key {static_cast<std::uint32_t> (i) << 8 | std::to_integer<std::uint32_t> (c)};
+        const std::size_t mask {slots.size() - 1};
+        std::size_t h {(key * 0x9E3779B1u) >> (32 - table_bits)};
+
+        for (;; h = (h + 1) & mask)
+        {
+            Slot &s = slots[h];
+            const std::uint32_t g {s.value >> code_bits};
+
+            if (g != generation && g != permanent)
+            {
+                if (size == limit)
+                    return false;
+
+                s.key = key;
+                s.value = generation << code_bits | static_cast<std::uint32_t> (size++);
+                return false;
+            }
+
+            if (s.key == key)
+            {
+                code = static_cast<Code> (s.value & ((1u << code_bits) - 1));
+                return true;
+            }
+        }
+    }
+
+    /// Next code to be assigned; codes below it are in use.
+    std::size_t size;
+
+    /// Number of codes, one more than the largest.
+    const std::size_t limit;
+
+private:
+
+    /// One cell of the hash table.
+    struct Slot {
+        std::uint32_t key;          ///< prefix code and byte
+        std::uint32_t value;        ///< generation in the top bits, code of the string below
+    };
+
+    /// Number of single-byte strings.
+    static const std::size_t single_codes {1 << std::numeric_limits<unsigned char>::digits};
+
+    /// Bits of `Slot::value` that hold the code; the rest hold the generation.
+    static const unsigned code_bits {24};
+    static const std::uint32_t generation_count {1u << (32 - code_bits)};
+
+    /// Generation of the strings added by `prime()`.
+    static const std::uint32_t permanent {generation_count - 1};
+
+    std::size_t first_code;
+
+    /// The table is kept at most half full, so that probe sequences stay short.
+    unsigned table_bits;
+    std::vector<Slot> slots;
+    std::uint32_t generation {0};
+};
+
+///
+/// @brief Dictionary used by the decompressors.
+///
+/// Besides its prefix code and last byte, every entry keeps the length and the
+/// first byte of its string. The string can then be written back to front
+/// straight into the output, and the first byte needed for the next entry is
+/// known without walking the prefix chain.
+///
+/// @tparam Code    type that holds a code
+///
+template <typename Code>
+class DecoderDictionary {
+public:
+
+    ///
+    /// @param first_code   code assigned to the first multi-byte string
+    /// @param width        width of the largest code, which sets the dictionary's capacity
+    ///
+    explicit DecoderDictionary(std::size_t first_code = single_codes,
+        unsigned width = std::numeric_limits<Code>::digits):
+        limit(std::size_t {1} << width),
+        first_code(first_code),
+        entries(limit)
+    {
+        const long int minc = std::numeric_limits<char>::min();
+        const long int maxc = std::numeric_limits<char>::max();
+
+        for (long int c = minc; c <= maxc; ++c)
+        {
+            const std::byte b {static_cast<unsigned char> (c)};
+
+            entries[c - minc] = {std::numeric_limits<Code>::max(), b, b, 1};
+        }
+
+        reset();
+    }
+
+    ///
+    /// @brief Removes every multi-byte string from the dictionary.
+    ///
+    void reset()
+    {
+        size = first_code;
+    }
+
+    ///
+    /// @brief Adds for good the strings that compressing `sample` would add.
+    ///
+    /// The strings are those of `EncoderDictionary::prime()`, with the same
+    /// codes, and `reset()` keeps them in the same way. Must be called before
+    /// the dictionary is used.
+    ///
+    void prime(std::span<const std::byte> sample)
+    {
+        // the compressor finds the strings; it only needs room for those of the sample
+        EncoderDictionary<Code> encoder(first_code,
+            std::min(bit_length(static_cast<std::uint32_t> (first_code + sample.size())),
+                bit_length(static_cast<std::uint32_t> (limit - 1))));
+        Code i;
+
+        for (std::size_t p = 0; p < sample.size() && size < limit / 2; ++p)
+            if (p == 0)
+                i = code_of<Code>(sample[p]);
+            else
+            if (!encoder.find_or_add(i, sample[p], i))
+            {
+                add(i, sample[p]);
+                i = code_of<Code>(sample[p]);
+            }
+
+        first_code = size;
+    }
+
+    ///
+    /// @brief Adds the string `i` + `c` with the next free code.
+    ///
+    /// In the fixed-width format, the first string after a reset may have a prefix
+    /// left over from the previous dictionary. Like the compressor, such a prefix
+    /// means whatever that code will hold in the new dictionary, so the length of
+    /// the entry is only worked out once it is used (see `resolve()`).
+    ///
+    void add(Code i, std::byte c)
+    {
+        Entry &e = entries[size];
+
+        e.prefix = i;
+        e.last = c;
+
+        if (i < size)
+        {
+            e.first = entries[i].first;
+            e.length = entries[i].length + 1;
+        }
+        else
+            e.length = 0;
+
+        ++size;
+    }
+
+    ///
+    /// @brief Makes sure the length and first byte of the string for `k` are known.
+    /// @returns the first byte of the string
+    ///
+    std::byte resolve(Code k)
+    {
+        Entry &e = entries[k];
+
+        if (e.length == 0)
+        {
+            const Entry &p = entries[e.prefix];
+
+            if (e.prefix >= size || p.length == 0)
+                throw std::runtime_error("invalid compressed code");
+
+            e.first = p.first;
+            e.length = p.length + 1;
+        }
+
+        return e.first;
+    }
+
+    ///
+    /// @brief Writes the string for `k`, which must be resolved, to `out`.
+    ///
+    void write(Code k, Output &out) const
+    {
+        std::uint32_t n {entries[k].length};
+        std::byte *p {out.reserve(n) + n};
+
+        // stops after `n` bytes even if a corrupted file made the chain loop
+        for (; n != 0; --n)
+        {
+            const Entry &e = entries[k];
+
+            *--p = e.last;
+            k = e.prefix;
+        }
+    }
+
+    /// Next code to be assigned; codes below it are in use.
+    std::size_t size;
+
+    /// Number of codes, one more than the largest.
+    const std::size_t limit;
+
+private:
+
+    /// One entry of the dictionary.
+    struct Entry {
+        Code prefix;                ///< code of the string without its last byte
+        std::byte last;             ///< last byte of the string
+        std::byte first;            ///< first byte of the string
+        std::uint32_t length;       ///< length of the string, or 0 if not yet known
+    };
+
+    /// Number of single-byte strings.
+    static const std::size_t single_codes {1 << std::numeric_limits<unsigned char>::digits};
+
+    std::size_t first_code;
+
+    /// Every code that fits in the width has an entry, so no lookup needs bounds checks.
+    std::vector<Entry> entries;
+};
+
+///
+/// @brief Checks the magic bytes and version at the start of `in`.
+///
+inline bool has_header(std::span<const std::byte> in, std::size_t size, char version)
+{
+    return in.size() >= size
+        && std::memcmp(in.data(), globals::magic, sizeof globals::magic) == 0
+        && static_cast<char> (in[sizeof globals::magic]) == version;
+}
+
+///
+/// @brief Compresses `in` into `out` in the fixed-width format, with `dictionary`, which is reset first.
+/// @returns the number of bytes written
+///
+inline std::size_t compress(std::span<const std::byte> in, Output out, EncoderDictionary<CodeType> &dictionary)
+{
+    stats::Timer t(stats::encode);
+    CodeType i {globals::dms}; // Index
+
+    dictionary.reset();
+
+    for (const std::byte c : in)
+    {
+        // dictionary's maximum size was reached
+        if (dictionary.size == globals::dms)
+        {
+            dictionary.reset();
+            stats::add(stats::resets, 1);
+        }
+
+        if (i == globals::dms)
+            i = code_of<CodeType>(c);
+        else
+        if (!dictionary.find_or_add(i, c, i))
+        {
+            out.write(&i, sizeof (CodeType));
+            i = code_of<CodeType>(c);
+        }
+    }
+
+    if (i != globals::dms)
+        out.write(&i, sizeof (CodeType));
+
+    stats::add(stats::bytes_in, in.size());
+    stats::add(stats::bytes_out, out.size());
+    stats::add(stats::codes, out.size() / sizeof (CodeType));
+    return out.size();
+}
+
+///
+/// @brief Compresses `in` into `out` in the fixed-width format.
+/// @returns the number of bytes written
+///
+inline std::size_t compress(std::span<const std::byte> in, Output out)
+{
+    EncoderDictionary<CodeType> dictionary;
+
+    return compress(in, std::move(out), dictionary);
+}
+
+///
+/// @brief Decompresses `in`, written by `compress()`, into `out`, with `dictionary`, which is reset first.
+/// @returns the number of bytes written
+///
+inline std::size_t decompress(std::span<const std::byte> in, Output out, DecoderDictionary<CodeType> &dictionary)
+{
+    stats::Timer t(stats::decode);
+    CodeType i {globals::dms}; // Index
+    CodeType k; // Key
+
+    if (in.size() % sizeof (CodeType) != 0)
+        throw std::runtime_error("corrupted compressed file");
+
+    dictionary.reset();
+
+    for (std::size_t p = 0; p < in.size(); p += sizeof (CodeType))
+    {
+        std::memcpy(&k, &in[p], sizeof (CodeType));
+
+        // dictionary's maximum size was reached
+        if (dictionary.size == globals::dms)
+        {
+            dictionary.reset();
+            stats::add(stats::resets, 1);
+        }
+
+        if (k > dictionary.size)
+            throw std::runtime_error("invalid compressed code");
+
+        if (k == dictionary.size)
+        {
+            if (i >= dictionary.size)
+                throw std::runtime_error("invalid compressed code");
+
+            dictionary.add(i, dictionary.resolve(i));
+            dictionary.resolve(k);
+        }
+        else
+        {
+            const std::byte first {dictionary.resolve(k)};
+
+            if (i != globals::dms)
+                dictionary.add(i, first);
+        }
+
+        dictionary.write(k, out);
+        i = k;
+    }
+
+    stats::add(stats::bytes_in, in.size());
+    stats::add(stats::bytes_out, out.size());
+    stats::add(stats::codes, in.size() / sizeof (CodeType));
+    return out.size();
+}
+
+///
+/// @brief Decompresses `in`, written by `compress()`, into `out`.
+/// @returns the number of bytes written
+///
+inline std::size_t decompress(std::span<const std::byte> in, Output out)
+{
+    DecoderDictionary<CodeType> dictionary;
+
+    return decompress(in, std::move(out), dictionary);
+}
+
+///
+/// @brief Where `encode_variable()` stands between two pieces of the same input.
+///
+template <typename Code>
+struct EncoderState {
+    Code i {std::numeric_limits<Code>::max()};     ///< code of the string not yet written, if any
+
+    // bytes read and bits written since the last reset, and at the last check
+    std::uint64_t bytes_in {0};
+    std::uint64_t bits_out {0};
+    std::uint64_t checked_bytes {0};
+    std::uint64_t checked_bits {0};
+    double best_ratio {0};
+};
+
+///
+/// @brief Writes `code` with just enough bits for the largest code the decoder can receive.
+/// @param next_code    next code of the encoder; the decoder adds the string for a code only
+///                     when it reads the next one, so it is one behind
+///
+template <typename Writer>
+void put_code(Writer &writer, std::uint32_t code, std::size_t next_code, unsigned max_width,
+    std::uint64_t &bits_out)
+{
+    const unsigned width {std::min(bit_length(static_cast<std::uint32_t> (next_code - 1)), max_width)};
+
+    writer.put(code, width);
+    bits_out += width;
+    stats::add(stats::codes, 1);
+}
+
+///
+/// @brief Writes the codes of `in`, one more piece of the input that `state` has seen so far.
+///
+/// The code of the last string is kept in `state`, since the next piece may
+/// make it longer. See `encode_variable()`.
+///
+template <typename Code, typename Writer>
+void encode_piece(std::span<const std::byte> in, Writer &writer, EncoderDictionary<Code> &dictionary,
+    unsigned max_width, EncoderState<Code> &state)
+{
+    const Code none {std::numeric_limits<Code>::max()};
+
+    // a copy of the state whose address does not escape stays in registers
+    EncoderState<Code> s {state};
+
+    for (const std::byte c : in)
+    {
+        ++s.bytes_in;
+
+        if (s.i == none)
+        {
+            s.i = code_of<Code>(c);
+            continue;
+        }
+
+        const std::size_t next_code {dictionary.size};
+
+        if (!dictionary.find_or_add(s.i, c, s.i))
+        {
+            put_code(writer, s.i, next_code, max_width, s.bits_out);
+
+            // the clear code may only follow a complete string
+            if (dictionary.size == dictionary.limit && s.bytes_in >= s.checked_bytes + globals::check_gap)
+            {
+                const double ratio {static_cast<double> (s.bytes_in) / s.bits_out};
+
+                // a dictionary trained on other data (say, random bytes) can keep
+                // a steady but poor ratio, so expanding data also starts over
+                const bool expanded {s.bits_out - s.checked_bits > 8 * (s.bytes_in - s.checked_bytes)};
+
+                if (ratio >= s.best_ratio && !expanded)
+                {
+                    s.best_ratio = ratio;
+                    s.checked_bytes = s.bytes_in;
+                    s.checked_bits = s.bits_out;
+                }
+                else
+                {
+                    put_code(writer, globals::clear_code, dictionary.size, max_width, s.bits_out);
+                    dictionary.reset();
+                    stats::add(stats::resets, 1);
+                    s = EncoderState<Code> {};
+                }
+            }
+
+            s.i = code_of<Code>(c);
+        }
+    }
+
+    state = s;
+}
+
+///
+/// @brief Writes the code of the string that `state` kept back, if any.
+/// @returns whether there was one
+///
+/// Once the decoder reads that code it has caught up with the encoder: its
+/// dictionary is the same, rather than one string behind.
+///
+template <typename Code, typename Writer>
+bool encode_pending(Writer &writer, EncoderDictionary<Code> &dictionary, unsigned max_width,
+    EncoderState<Code> &state)
+{
+    const Code none {std::numeric_limits<Code>::max()};
+
+    if (state.i == none)
+        return false;
+
+    put_code(writer, state.i, dictionary.size, max_width, state.bits_out);
+    state.i = none;
+    return true;
+}
+
+///
+/// @brief Compresses `in` into `out` using codes that grow from 9 to `max_width` bits.
+/// @tparam Code            type that holds a code of `max_width` bits
+/// @tparam Writer          `BitWriter`, or any type whose `put()` takes a code and its width
+/// @param [in] in          input buffer
+/// @param [out] writer     destination of the codes
+/// @param dictionary       dictionary of `max_width` bits, which is reset first
+/// @param max_width        width of the codes when the dictionary is full
+///
+/// Each code is written with just enough bits for the largest code the decoder
+/// can receive at that point. Once the dictionary is full it is kept as it is,
+/// and the compression ratio since the last reset is checked every
+/// `globals::check_gap` input bytes, as in the Unix `compress` utility. As soon
+/// as the ratio gets worse, `globals::clear_code` is written and both sides
+/// start over with an empty dictionary.
+///
+template <typename Code, typename Writer>
+void encode_variable(std::span<const std::byte> in, Writer &writer, EncoderDictionary<Code> &dictionary,
+    unsigned max_width)
+{
+    EncoderState<Code> state;
+
+    dictionary.reset();
+    encode_piece(in, writer, dictionary, max_width, state);
+    encode_pending(writer, dictionary, max_width, state);
+}
+
+///
+/// @brief Decompresses the codes that `encode_piece()` wrote, until `reader` runs out or a flush point.
+/// @param [in,out] i       code read last, or the largest value of `Code` at the start of a string
+/// @param flushes          whether `globals::flush_code` marks a flush point, as in the stream format
+/// @returns true if it stopped at a flush point
+///
+template <typename Code, typename Reader>
+bool decode_piece(Reader &reader, Output &out, DecoderDictionary<Code> &dictionary, unsigned max_width,
+    Code &i, bool flushes)
+{
+    const Code none {std::numeric_limits<Code>::max()};
+
+    Code k; // Key
+
+    // right after a reset, only the strings already in the dictionary (single
+    // bytes, unless it was primed) and the clear code can follow
+    while (reader.get(k, std::min(bit_length(static_cast<std::uint32_t> (i == none ? dictionary.size - 1 :
+        dictionary.size)), max_width)))
+    {
+        stats::add(stats::codes, 1);
+
+        if (k == globals::clear_code)
+        {
+            dictionary.reset();
+            stats::add(stats::resets, 1);
+            i = none;
+            continue;
+        }
+
+        if (k == globals::flush_code && flushes)
+        {
+            i = none;
+            return true;
+        }
+
+        if (k > dictionary.size || (i == none && k == dictionary.size))
+            throw std::runtime_error("invalid compressed code");
+
+        if (k == dictionary.size)
+            dictionary.add(i, dictionary.resolve(i));
+        else
+        {
+            const std::byte first {dictionary.resolve(k)};
+
+            if (i != none && dictionary.size < dictionary.limit)
+                dictionary.add(i, first);
+        }
+
+        dictionary.write(k, out);
+        i = k;
+    }
+
+    return false;
+}
+
+///
+/// @brief Decompresses the codes that `encode_variable()` wrote.
+/// @tparam Code            type that holds a code of `max_width` bits
+/// @tparam Reader          `BitReader`, or any type whose `get()` reads a code of a given width
+/// @param [in] reader      source of the codes
+/// @param [out] out        output buffer
+/// @param dictionary       dictionary of `max_width` bits, which is reset first
+/// @param max_width        width of the codes when the dictionary is full
+///
+template <typename Code, typename Reader>
+void decode_variable(Reader &reader, Output &out, DecoderDictionary<Code> &dictionary, unsigned max_width)
+{
+    Code i {std::numeric_limits<Code>::max()}; // Index
+
+    dictionary.reset();
+    decode_piece(reader, out, dictionary, max_width, i, false);
+}
+
+///
+/// @brief Reads the maximum code width from a header, checking that it is valid.
+///
+inline unsigned header_width(std::span<const std::byte> in)
+{
+    const unsigned max_width {std::to_integer<unsigned> (in[sizeof globals::magic + 1])};
+
+    if (max_width < globals::min_width || max_width > globals::max_width)
+        throw std::runtime_error("invalid maximum code width");
+
+    return max_width;
+}
+
+///
+/// @brief Whether codes of `max_width` bits fit in `std::uint16_t`.
+///
+/// The largest value of the type marks "no code", so it cannot be a code itself.
+///
+inline bool narrow_codes(unsigned max_width)
+{
+    return max_width < std::numeric_limits<std::uint16_t>::digits;
+}
+
+///
+/// @brief Reusable context for compressing many inputs.
+///
+/// The one-shot functions build a dictionary on every call, and at the default
+/// width its hash table alone takes a megabyte: for small inputs, allocating and
+/// touching it costs more than compressing them. A context creates each
+/// dictionary it needs on first use and afterwards only resets it, which for
+/// the hash table means bumping its generation, so compressing allocates
+/// nothing but the output. A context is not thread-safe; keep one per thread.
+///
+class Compressor {
+public:
+
+    ///
+    /// @param max_width    width of the variable-width codes when the dictionary is full
+    /// @param sample       strings the dictionary is primed with for good, if any (see `EncoderDictionary::prime()`)
+    ///
+    explicit Compressor(unsigned max_width = globals::default_width, std::span<const std::byte> sample = {}):
+        max_width(max_width)
+    {
+        if (sample.empty())
+            return;
+
+        if (narrow_codes(max_width))
+            narrow_dictionary().prime(sample);
+        else
+            wide_dictionary().prime(sample);
+    }
+
+    ///
+    /// @brief Width of the variable-width codes when the dictionary is full.
+    ///
+    unsigned width() const
+    {
+        return max_width;
+    }
+
+    ///
+    /// @brief Calls `encode_variable()` with the dictionary of the context, then flushes `writer`.
+    ///
+    template <typename Writer>
+    void encode(std::span<const std::byte> in, Writer &writer)
+    {
+        if (narrow_codes(max_width))
+            encode_variable(in, writer, narrow_dictionary(), max_width);
+        else
+            encode_variable(in, writer, wide_dictionary(), max_width);
+
+        writer.flush();
+    }
+
+    ///
+    /// @brief As `lzw::compress()`.
+    ///
+    std::size_t compress(std::span<const std::byte> in, Output out)
+    {
+        if (!fixed)
+            fixed = std::make_unique<EncoderDictionary<CodeType>>();
+
+        return lzw::compress(in, std::move(out), *fixed);
+    }
+
+    ///
+    /// @brief As `lzw::compress_variable()`.
+    ///
+    std::size_t compress_variable(std::span<const std::byte> in, Output out)
+    {
+        stats::Timer t(stats::encode);
+
+        out.write(globals::magic, sizeof globals::magic);
+        out.put(static_cast<std::byte> (globals::format_version));
+        out.put(static_cast<std::byte> (max_width));
+
+        BitWriter writer(out);
+
+        encode(in, writer);
+        stats::add(stats::bytes_in, in.size());
+        stats::add(stats::bytes_out, out.size());
+        return out.size();
+    }
+
+    ///
+    /// @brief As `lzw::compress_hybrid()`.
+    ///
+    std::size_t compress_hybrid(std::span<const std::byte> in, Output out)
+    {
+        stats::Timer t(stats::encode);
+
+        out.write(globals::magic, sizeof globals::magic);
+        out.put(static_cast<std::byte> (globals::hybrid_version));
+        out.put(static_cast<std::byte> (max_width));
+
+        HuffmanWriter writer(out);
+
+        encode(in, writer);
+        stats::add(stats::bytes_in, in.size());
+        stats::add(stats::bytes_out, out.size());
+        return out.size();
+    }
+
+    ///
+    /// @brief As `lzw::compress_chunk()`.
+    ///
+    std::size_t compress_chunk(std::span<const std::byte> in, Output out)
+    {
+        stats::Timer t(stats::encode);
+        BitWriter writer(out);
+
+        encode(in, writer);
+        return out.size();
+    }
+
+    ///
+    /// @brief As `lzw::pack_chunk()`.
+    ///
+    bool pack_chunk(std::span<const std::byte> in, std::vector<std::byte> &out)
+    {
+        out.clear();
+        compress_chunk(in, out);
+
+        if (out.size() < in.size())
+            return false;
+
+        out.assign(in.begin(), in.end());
+        return true;
+    }
+
+private:
+
+    EncoderDictionary<std::uint16_t> &narrow_dictionary()
+    {
+        if (!narrow)
+            narrow = std::make_unique<EncoderDictionary<std::uint16_t>>(globals::first_free_code, max_width);
+
+        return *narrow;
+    }
+
+    EncoderDictionary<std::uint32_t> &wide_dictionary()
+    {
+        if (!wide)
+            wide = std::make_unique<EncoderDictionary<std::uint32_t>>(globals::first_free_code, max_width);
+
+        return *wide;
+    }
+
+    unsigned max_width;
+
+    // only the one that fits `max_width` is used
+    std::unique_ptr<EncoderDictionary<std::uint16_t>> narrow;
+    std::unique_ptr<EncoderDictionary<std::uint32_t>> wide;
+
+    /// Dictionary of the fixed-width format.
+    std::unique_ptr<EncoderDictionary<CodeType>> fixed;
+};
+
+///
+/// @brief Reusable context for decompressing many inputs.
+///
+/// The counterpart of `Compressor`: it keeps its dictionaries between calls and
+/// only resets them. It is not thread-safe; keep one per thread.
+///
+class Decompressor {
+public:
+
+    ///
+    /// @param max_width    width of the variable-width codes when the dictionary is full
+    /// @param sample       strings the dictionary is primed with for good, if any, as in the compressor
+    ///
+    explicit Decompressor(unsigned max_width = globals::default_width, std::span<const std::byte> sample = {}):
+        max_width(max_width),
+        primed(!sample.empty())
+    {
+        if (!primed)
+            return;
+
+        if (narrow_codes(max_width))
+            narrow_dictionary().prime(sample);
+        else
+            wide_dictionary().prime(sample);
+    }
+
+    ///
+    /// @brief Width of the variable-width codes when the dictionary is full.
+    ///
+    unsigned width() const
+    {
+        return max_width;
+    }
+
+    ///
+    /// @brief Switches to codes of `width` bits, building new dictionaries on their first use.
+    ///
+    /// A primed context cannot switch, since its dictionary depends on the width.
+    ///
+    void set_width(unsigned width)
+    {
+        if (width == max_width)
+            return;
+
+        if (primed)
+            throw std::runtime_error("primed LZW data with another code width");
+
+        max_width = width;
+        narrow.reset();
+        wide.reset();
+    }
+
+    ///
+    /// @brief Calls `decode_variable()` with the dictionary of the context.
+    ///
+    template <typename Reader>
+    void decode(Reader &reader, Output &out)
+    {
+        if (narrow_codes(max_width))
+            decode_variable(reader, out, narrow_dictionary(), max_width);
+        else
+            decode_variable(reader, out, wide_dictionary(), max_width);
+    }
+
+    ///
+    /// @brief As `lzw::decompress()`.
+    ///
+    std::size_t decompress(std::span<const std::byte> in, Output out)
+    {
+        if (!fixed)
+            fixed = std::make_unique<DecoderDictionary<CodeType>>();
+
+        return lzw::decompress(in, std::move(out), *fixed);
+    }
+
+    ///
+    /// @brief As `lzw::decompress_variable()`; the width comes from the header.
+    ///
+    std::size_t decompress_variable(std::span<const std::byte> in, Output out)
+    {
+        if (!has_header(in, globals::header_size, globals::format_version))
+            throw std::runtime_error("not a variable-width LZW file");
+
+        stats::Timer t(stats::decode);
+        BitReader reader(in.subspan(globals::header_size));
+
+        set_width(header_width(in));
+        decode(reader, out);
+        stats::add(stats::bytes_in, in.size());
+        stats::add(stats::bytes_out, out.size());
+        return out.size();
+    }
+
+    ///
+    /// @brief As `lzw::decompress_hybrid()`; the width comes from the header.
+    ///
+    std::size_t decompress_hybrid(std::span<const std::byte> in, Output out)
+    {
+        if (!has_header(in, globals::header_size, globals::hybrid_version))
+            throw std::runtime_error("not a hybrid LZW file");
+
+        stats::Timer t(stats::decode);
+        HuffmanReader reader(in.subspan(globals::header_size));
+
+        set_width(header_width(in));
+        decode(reader, out);
+        stats::add(stats::bytes_in, in.size());
+        stats::add(stats::bytes_out, out.size());
+        return out.size();
+    }
+
+    ///
+    /// @brief As `lzw::decompress_chunk()`, with the width of the context.
+    ///
+    void decompress_chunk(std::span<const std::byte> in, std::span<std::byte> out, bool stored = false)
+    {
+        stats::Timer t(stats::decode);
+
+        if (stored)
+        {
+            if (in.size() != out.size())
+                throw std::runtime_error("corrupted compressed file");
+
+            std::memcpy(out.data(), in.data(), in.size());
+            return;
+        }
+
+        Output chunk_out(out);
+        BitReader reader(in);
+
+        decode(reader, chunk_out);
+
+        if (chunk_out.size() != out.size())
+            throw std::runtime_error("corrupted compressed file");
+    }
+
+private:
+
+    DecoderDictionary<std::uint16_t> &narrow_dictionary()
+    {
+        if (!narrow)
+            narrow = std::make_unique<DecoderDictionary<std::uint16_t>>(globals::first_free_code, max_width);
+
+        return *narrow;
+    }
+
+    DecoderDictionary<std::uint32_t> &wide_dictionary()
+    {
+        if (!wide)
+            wide = std::make_unique<DecoderDictionary<std::uint32_t>>(globals::first_free_code, max_width);
+
+        return *wide;
+    }
+
+    unsigned max_width;
+    bool primed;
+
+    std::unique_ptr<DecoderDictionary<std::uint16_t>> narrow;
+    std::unique_ptr<DecoderDictionary<std::uint32_t>> wide;
+    std::unique_ptr<DecoderDictionary<CodeType>> fixed;
+};
+
+///
+/// @brief Compresses `in` into `out` in the variable-width format.
+/// @param [in] in          input buffer
+/// @param [out] out        output buffer
+/// @param max_width        width of the codes when the dictionary is full
+/// @returns the number of bytes written
+///
+inline std::size_t compress_variable(std::span<const std::byte> in, Output out,
+    unsigned max_width = globals::default_width)
+{
+    return Compressor(max_width).compress_variable(in, std::move(out));
+}
+
+///
+/// @brief Decompresses `in`, written by `compress_variable()`, into `out`.
+/// @returns the number of bytes written
+///
+inline std::size_t decompress_variable(std::span<const std::byte> in, Output out)
+{
+    return Decompressor().decompress_variable(in, std::move(out));
+}
+
+///
+/// @brief Compresses `in` into `out` in the hybrid format.
+/// @param [in] in          input buffer
+/// @param [out] out        output buffer
+/// @param max_width        width of the codes when the dictionary is full
+/// @returns the number of bytes written
+///
+/// The codes are the same as in `compress_variable()`, but instead of being
+/// packed with a fixed number of bits each, they are Huffman-coded in blocks.
+/// LZW codes are far from uniform (single bytes and the early, shorter strings
+/// are used most), so this is smaller at a modest cost in speed.
+///
+inline std::size_t compress_hybrid(std::span<const std::byte> in, Output out,
+    unsigned max_width = globals::default_width)
+{
+    return Compressor(max_width).compress_hybrid(in, std::move(out));
+}
+
+///
+/// @brief Decompresses `in`, written by `compress_hybrid()`, into `out`.
+/// @returns the number of bytes written
+///
+inline std::size_t decompress_hybrid(std::span<const std::byte> in, Output out)
+{
+    return Decompressor().decompress_hybrid(in, std::move(out));
+}
+
+///
+/// @brief Writes the `globals::primed_header_size` bytes of the header of a primed message to `header`.
+///
+inline void put_primed_header(std::byte *header, unsigned max_width, std::uint32_t id)
+{
+    std::memcpy(header, globals::magic, sizeof globals::magic);
+    header[sizeof globals::magic] = static_cast<std::byte> (globals::primed_version);
+    header[sizeof globals::magic + 1] = static_cast<std::byte> (max_width);
+    put_u32(header + sizeof globals::magic + 2, id);
+}
+
+///
+/// @brief Compressor of small messages in the primed format.
+///
+/// Its dictionary is primed with the sample of a trained dictionary when the
+/// compressor is created, and every message starts from it: long strings are
+/// found from the first bytes on, and getting back to the primed dictionary
+/// costs no more than emptying it would. A compressor keeps its dictionary
+/// between calls, so each thread needs its own.
+///
+class PrimedCompressor {
+public:
+
+    ///
+    /// @param d            trained dictionary, whose ID goes into every message
+    /// @param max_width    width of the codes when the dictionary is full
+    ///
+    explicit PrimedCompressor(const dictionary::Dictionary &d, unsigned max_width = globals::default_width):
+        id(d.id),
+        coder(max_width, d.sample)
+    {
+    }
+
+    ///
+    /// @brief Compresses `in` into `out` as one message.
+    /// @returns the number of bytes written
+    ///
+    std::size_t compress(std::span<const std::byte> in, Output out)
+    {
+        stats::Timer t(stats::encode);
+
+        put_primed_header(out.reserve(globals::primed_header_size), coder.width(), id);
+
+        BitWriter writer(out);
+
+        coder.encode(in, writer);
+        stats::add(stats::bytes_in, in.size());
+        stats::add(stats::bytes_out, out.size());
+        return out.size();
+    }
+
+private:
+
+    std::uint32_t id;
+    Compressor coder;
+};
+
+///
+/// @brief Decompressor of the messages written by `PrimedCompressor`.
+///
+/// It must be created from the same dictionary and code width as the
+/// compressor; messages from any other are rejected. Like the compressor, it
+/// keeps its dictionary between calls, so each thread needs its own.
+///
+class PrimedDecompressor {
+public:
+
+    ///
+    /// @param d            trained dictionary the messages were compressed with
+    /// @param max_width    width of the codes when the dictionary is full
+    ///
+    explicit PrimedDecompressor(const dictionary::Dictionary &d, unsigned max_width = globals::default_width):
+        id(d.id),
+        coder(max_width, d.sample)
+    {
+    }
+
+    ///
+    /// @brief Decompresses the message `in` into `out`.
+    /// @returns the number of bytes written
+    ///
+    std::size_t decompress(std::span<const std::byte> in, Output out)
+    {
+        if (!has_header(in, globals::primed_header_size, globals::primed_version))
+            throw std::runtime_error("not a primed LZW message");
+
+        if (header_width(in) != coder.width())
+            throw std::runtime_error("primed LZW message with another code width");
+
+        if (get_u32(&in[sizeof globals::magic + 2]) != id)
+            throw std::runtime_error("primed LZW message from another dictionary");
+
+        stats::Timer t(stats::decode);
+        BitReader reader(in.subspan(globals::primed_header_size));
+
+        coder.decode(reader, out);
+        stats::add(stats::bytes_in, in.size());
+        stats::add(stats::bytes_out, out.size());
+        return out.size();
+    }
+
+private:
+
+    std::uint32_t id;
+    Decompressor coder;
+};
+
+///
+/// @brief Writes the `globals::header_size` bytes of the header of a stream to `header`.
+///
+inline void put_stream_header(std::byte *header, unsigned max_width)
+{
+    std::memcpy(header, globals::magic, sizeof globals::magic);
+    header[sizeof globals::magic] = static_cast<std::byte> (globals::stream_version);
+    header[sizeof globals::magic + 1] = static_cast<std::byte> (max_width);
+}
+
+///
+/// @brief Compressor of data that arrives a piece at a time, in the stream format.
+///
+/// The codes are those of the variable-width format, but the code of the last
+/// string of a piece stays pending, since the next piece may make it longer,
+/// and so do the last few bits. `flush()` writes them followed by
+/// `globals::flush_code` and pads the bit stream to a whole byte, so that a
+/// decoder that has read up to there can produce every byte compressed so far.
+/// Unlike `globals::clear_code`, a flush point keeps the dictionary: flushing
+/// after every message of a live stream costs a couple of bytes, not the
+/// dictionary built so far.
+///
+class StreamCompressor {
+public:
+
+    ///
+    /// @param max_width    width of the codes when the dictionary is full
+    ///
+    explicit StreamCompressor(unsigned max_width = globals::default_width):
+        max_width(max_width)
+    {
+        if (narrow_codes(max_width))
+            narrow = std::make_unique<Coder<std::uint16_t>>(max_width);
+        else
+            wide = std::make_unique<Coder<std::uint32_t>>(max_width);
+    }
+
+    ///
+    /// @brief Compresses `in`, the next piece of the stream, into `out`.
+    /// @returns the number of bytes written, which may leave out the end of `in` until the next flush
+    ///
+    std::size_t compress(std::span<const std::byte> in, Output out)
+    {
+        stats::Timer t(stats::encode);
+
+        start(out);
+
+        BitWriter writer(out, pending);
+
+        visit([&](auto &coder) {
+            encode_piece(in, writer, coder.dictionary, max_width, coder.state);
+        });
+
+        pending = writer.pending();
+        stats::add(stats::bytes_in, in.size());
+        stats::add(stats::bytes_out, out.size());
+        return out.size();
+    }
+
+    ///
+    /// @brief Writes to `out` whatever is pending, then a flush point.
+    /// @returns the number of bytes written
+    ///
+    std::size_t flush(Output out)
+    {
+        stats::Timer t(stats::encode);
+
+        start(out);
+
+        BitWriter writer(out, pending);
+
+        visit([&](auto &coder) {
+            // a decoder that has caught up can already receive the next code of the encoder
+            const bool caught_up {encode_pending(writer, coder.dictionary, max_width, coder.state)};
+
+            put_code(writer, globals::flush_code, coder.dictionary.size + caught_up, max_width,
+                coder.state.bits_out);
+        });
+
+        writer.flush();
+        pending = {};
+        stats::add(stats::bytes_out, out.size());
+        return out.size();
+    }
+
+private:
+
+    template <typename Code>
+    struct Coder {
+        explicit Coder(unsigned max_width):
+            dictionary(globals::stream_first_code, max_width)
+        {
+        }
+
+        EncoderDictionary<Code> dictionary;
+        EncoderState<Code> state;
+    };
+
+    ///
+    /// @brief Calls `f` with the coder that fits the code width.
+    ///
+    template <typename F>
+    void visit(F f)
+    {
+        if (narrow)
+            f(*narrow);
+        else
+            f(*wide);
+    }
+
+    ///
+    /// @brief Writes the header, if this is the start of the stream.
+    ///
+    void start(Output &out)
+    {
+        if (started)
+            return;
+
+        put_stream_header(out.reserve(globals::header_size), max_width);
+        started = true;
+    }
+
+    unsigned max_width;
+    bool started {false};
+    PendingBits pending;
+
+    // only the one that fits `max_width` exists
+    std::unique_ptr<Coder<std::uint16_t>> narrow;
+    std::unique_ptr<Coder<std::uint32_t>> wide;
+};
+
+///
+/// @brief Decompressor of the stream written by `StreamCompressor`.
+///
+/// The stream can be fed in pieces of any size, as it arrives. Every call
+/// writes out all the strings whose codes are complete, which means all the
+/// data up to the last flush point in the stream so far, and keeps the rest
+/// for the next call.
+///
+class StreamDecompressor {
+public:
+
+    ///
+    /// @brief Decompresses `in`, the next piece of the stream, into `out`.
+    /// @returns the number of bytes written
+    ///
+    std::size_t decompress(std::span<const std::byte> in, Output out)
+    {
+        stats::Timer t(stats::decode);
+
+        // the header may itself arrive in pieces
+        for (; header_bytes < globals::header_size && !in.empty(); in = in.subspan(1))
+            header[header_bytes++] = in.front();
+
+        if (header_bytes < globals::header_size)
+            return 0;
+
+        if (!narrow && !wide)
+            start();
+
+        BitReader reader(in, pending);
+
+        visit([&](auto &coder) {
+            while (decode_piece(reader, out, coder.dictionary, max_width, coder.i, true))
+                reader.align();
+        });
+
+        pending = reader.pending();
+        stats::add(stats::bytes_in, in.size());
+        stats::add(stats::bytes_out, out.size());
+        return out.size();
+    }
+
+private:
+
+    template <typename Code>
+    struct Coder {
+        explicit Coder(unsigned max_width):
+            dictionary(globals::stream_first_code, max_width)
+        {
+        }
+
+        DecoderDictionary<Code> dictionary;
+        Code i {std::numeric_limits<Code>::max()};
+    };
+
+    ///
+    /// @brief Calls `f` with the coder that fits the code width.
+    ///
+    template <typename F>
+    void visit(F f)
+    {
+        if (narrow)
+            f(*narrow);
+        else
+            f(*wide);
+    }
+
+    ///
+    /// @brief Checks the header and creates the coder for its code width.
+    ///
+    void start()
+    {
+        if (!has_header(header, globals::header_size, globals::stream_version))
+            throw std::runtime_error("not an LZW stream");
+
+        max_width = header_width(header);
+
+        if (narrow_codes(max_width))
+            narrow = std::make_unique<Coder<std::uint16_t>>(max_width);
+        else
+            wide = std::make_unique<Coder<std::uint32_t>>(max_width);
+    }
+
+    std::byte header[globals::header_size];
+    std::size_t header_bytes {0};
+    unsigned max_width {0};
+    PendingBits pending;
+
+    // only the one that fits `max_width` exists, once the header is read
+    std::unique_ptr<Coder<std::uint16_t>> narrow;
+    std::unique_ptr<Coder<std::uint32_t>> wide;
+};
+
+///
+/// @brief Writes the `globals::parallel_header_size` bytes of the header of a parallel file to `header`.
+///
+inline void put_parallel_header(std::byte *header, unsigned max_width)
+{
+    std::memcpy(header, globals::magic, sizeof globals::magic);
+    header[sizeof globals::magic] = static_cast<std::byte> (globals::parallel_version);
+    header[sizeof globals::magic + 1] = static_cast<std::byte> (max_width);
+    put_u32(header + sizeof globals::magic + 2, globals::chunk_size);
+}
+
+///
+/// @brief Compresses one chunk of a parallel file, with a dictionary of its own.
+/// @returns the number of bytes written
+///
+inline std::size_t compress_chunk(std::span<const std::byte> in, Output out, unsigned max_width)
+{
+    return Compressor(max_width).compress_chunk(in, std::move(out));
+}
+
+///
+/// @brief Compresses one chunk of a parallel file into `out`, or copies it if the codes would not be smaller.
+/// @returns whether the chunk was stored as it is
+///
+inline bool pack_chunk(std::span<const std::byte> in, std::vector<std::byte> &out, unsigned max_width)
+{
+    return Compressor(max_width).pack_chunk(in, out);
+}
+
+///
+/// @brief Decompresses one chunk of a parallel file into `out`, which must have exactly its original size.
+///
+inline void decompress_chunk(std::span<const std::byte> in, std::span<std::byte> out, unsigned max_width,
+    bool stored = false)
+{
+    Decompressor(max_width).decompress_chunk(in, out, stored);
+}
+
+///
+/// @brief Where the chunks of a parallel file are, according to its table.
+///
+struct ChunkTable {
+    std::vector<std::uint64_t> offsets;     ///< start of every compressed chunk in the file, then of the table
+    std::vector<std::uint64_t> starts;      ///< start of every chunk in the original data, then its size
+    std::vector<bool> stored;               ///< whether every chunk is stored as it is
+};
+
+///
+/// @brief Size of the table at the end of a parallel file, including the chunk count that ends it.
+/// @param [in] end         the last 4 bytes of the file
+/// @param file_size        size of the file, at least `globals::parallel_header_size + 4`
+///
+inline std::size_t chunk_table_size(const std::byte *end, std::uint64_t file_size)
+{
+    // the table must fit between the header and the end of the file
+    const std::size_t count {get_u32(end)};
+
+    if (count > (file_size - globals::parallel_header_size - 4) / globals::table_entry_size)
+        throw std::runtime_error("corrupted chunk table");
+
+    return count * globals::table_entry_size + 4;
+}
+
+///
+/// @brief Reads the table at the end of a parallel file, checking that it matches the file.
+/// @param [in] header      the header of the file, already checked with `has_header()`
+/// @param [in] table       the last `chunk_table_size()` bytes of the file
+/// @param file_size        size of the file
+///
+inline ChunkTable read_chunk_table(std::span<const std::byte> header, std::span<const std::byte> table,
+    std::uint64_t file_size)
+{
+    const std::uint32_t chunk_size {get_u32(&header[sizeof globals::magic + 2])};
+    const std::size_t count {(table.size() - 4) / globals::table_entry_size};
+    ChunkTable chunks {std::vector<std::uint64_t> (count + 1, globals::parallel_header_size),
+        std::vector<std::uint64_t> (count + 1, 0), std::vector<bool> (count)};
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        std::uint32_t original {get_u32(&table[i * globals::table_entry_size + 4])};
+
+        chunks.stored[i] = (original & globals::stored_chunk) != 0;
+        original &= ~globals::stored_chunk;
+
+        if (original > chunk_size)
+            throw std::runtime_error("corrupted chunk table");
+
+        chunks.offsets[i + 1] = chunks.offsets[i] + get_u32(&table[i * globals::table_entry_size]);
+        chunks.starts[i + 1] = chunks.starts[i] + original;
+    }
+
+    // the chunks must end exactly where the table starts
+    if (chunks.offsets[count] != file_size - table.size())
+        throw std::runtime_error("corrupted chunk table");
+
+    return chunks;
+}
+
+///
+/// @brief Compresses `in` into `out` as independent chunks, on `workers` threads.
+/// @param [in] in          input buffer
+/// @param [out] out        output buffer
+/// @param max_width        width of the codes when a dictionary is full
+/// @param workers          number of threads
+/// @returns the number of bytes written
+///
+/// The input is cut into chunks of `globals::chunk_size` bytes, and each one is
+/// compressed with its own dictionary, as in `compress_variable()`, unless its
+/// codes would not be smaller, in which case it is stored as it is. The chunks
+/// are written in order after a header, and followed by a table with the
+/// compressed and original size of every chunk, so that they can also be
+/// decompressed in parallel.
+///
+inline std::size_t compress_parallel(std::span<const std::byte> in, Output out,
+    unsigned max_width = globals::default_width, unsigned workers = parallel::default_workers())
+{
+    const std::size_t count {(in.size() + globals::chunk_size - 1) / globals::chunk_size};
+    const std::size_t window {2 * static_cast<std::size_t> (workers)};
+
+    std::vector<std::vector<std::byte>> results(window);
+    std::vector<std::byte> table(count * globals::table_entry_size + 4);
+    std::vector<Compressor> coders;
+
+    for (unsigned w = 0; w < workers; ++w)
+        coders.emplace_back(max_width);
+
+    put_parallel_header(out.reserve(globals::parallel_header_size), max_width);
+
+    parallel::run_ordered(count, workers, window,
+        [&](unsigned w, std::size_t i) {
+            const std::span<const std::byte> chunk {in.subspan(i * globals::chunk_size,
+                std::min<std::size_t> (globals::chunk_size, in.size() - i * globals::chunk_size))};
+            const std::uint32_t flag {coders[w].pack_chunk(chunk, results[i % window]) ? globals::stored_chunk : 0};
+
+            put_u32(&table[i * globals::table_entry_size + 4], static_cast<std::uint32_t> (chunk.size()) | flag);
+        },
+        [&](std::size_t i) {
+            const std::vector<std::byte> &result = results[i % window];
+
+            put_u32(&table[i * globals::table_entry_size], static_cast<std::uint32_t> (result.size()));
+            out.write(result.data(), result.size());
+        });
+
+    put_u32(&table[count * globals::table_entry_size], static_cast<std::uint32_t> (count));
+    out.write(table.data(), table.size());
+    stats::add(stats::bytes_in, in.size());
+    stats::add(stats::bytes_out, out.size());
+    return out.size();
+}
+
+///
+/// @brief Decompresses `in`, written by `compress_parallel()`, into `out` on `workers` threads.
+/// @returns the number of bytes written
+///
+/// The table gives the original size of every chunk, so each thread decodes its
+/// chunks straight to their final place in `out`.
+///
+inline std::size_t decompress_parallel(std::span<const std::byte> in, Output out,
+    unsigned workers = parallel::default_workers())
+{
+    if (!has_header(in, globals::parallel_header_size + 4, globals::parallel_version))
+        throw std::runtime_error("not a parallel LZW file");
+
+    const unsigned max_width {header_width(in)};
+    const std::size_t table_size {chunk_table_size(&in[in.size() - 4], in.size())};
+    const ChunkTable chunks {read_chunk_table(in.first(globals::parallel_header_size), in.last(table_size), in.size())};
+    const std::size_t count {chunks.starts.size() - 1};
+
+    std::byte *const destination {out.reserve(chunks.starts[count])};
+    std::vector<Decompressor> coders;
+
+    for (unsigned w = 0; w < workers; ++w)
+        coders.emplace_back(max_width);
+
+    parallel::run(count, workers, [&](unsigned w, std::size_t i) {
+        coders[w].decompress_chunk(in.subspan(chunks.offsets[i], chunks.offsets[i + 1] - chunks.offsets[i]),
+            std::span<std::byte> (destination + chunks.starts[i], chunks.starts[i + 1] - chunks.starts[i]),
+            chunks.stored[i]);
+    });
+
+    stats::add(stats::bytes_in, in.size());
+    stats::add(stats::bytes_out, out.size());
+    return out.size();
+}
+
+} // namespace lzw
+
+#endif // LZW_HPP
@@ -5,8 +5,18 @@
 /// @brief LZW file compressor
 /// @version 3
 ///
-/// This is the C++11 implementation of a Lempel-Ziv-Welch single-file command-line compressor.
-/// It uses the simpler fixed-width code compression method.
+/// This is the C++20 implementation of a Lempel-Ziv-Welch single-file command-line compressor.
+/// It uses the simpler fixed-width code compression method by default, and can
+/// also pack variable-width codes into a separate file format, optionally split
+/// into chunks that are processed in parallel, or Huffman-code them.
+/// With a dictionary trained by the `train` tool, the variable-width format
+/// primes the LZW dictionary with its sample, which suits small messages.
+/// The stream format compresses live input as it arrives, with a flush point
+/// whenever the input pauses, so its decoder is never left waiting for more.
+/// The codecs themselves live in the header-only library `lzw.hpp`; the stream
+/// functions in this file just load the input into memory and call them, except
+/// for the chunked format, whose chunks are read, coded and written by the
+/// stages of a pipeline that overlap with each other.
 /// It was written with Doxygen comments.
 ///
 /// @see http://en.wikipedia.org/wiki/Lempel%E2%80%93Ziv%E2%80%93Welch
@@ -17,7 +27,6 @@
 /// @see http://www.doxygen.org/
 ///
 
-#include <algorithm>
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
@@ -26,25 +35,46 @@
 #include <ios>
 #include <iostream>
 #include <istream>
-#include <limits>
-#include <map>
 #include <memory>
 #include <ostream>
+#include <span>
 #include <stdexcept>
 #include <string>
-#include <utility>
 #include <vector>
-#include <chrono>
+#include "lzw.hpp"
+#include "../common/pipeline.hpp"
 
-/// Type used to store and retrieve codes.
-using CodeType = std::uint16_t;
+STATS_COUNT_ALLOCATIONS()
 
-namespace globals {
+///
+/// @brief Reads what is left of `is` into memory.
+///
+std::vector<std::byte> read_all(std::istream &is)
+{
+    const std::size_t block_size {1024 * 1024};
+    stats::Timer t(stats::read);
+
+    std::vector<std::byte> data;
+
+    do
+    {
+        data.resize(data.size() + block_size);
+        is.read(reinterpret_cast<char *> (data.data() + data.size() - block_size), block_size);
+        data.resize(data.size() - block_size + is.gcount());
+    }
+    while (is);
 
-/// Dictionary Maximum Size (when reached, the dictionary will be reset)
-const CodeType dms {std::numeric_limits<CodeType>::max()};
+    return data;
+}
 
-} // namespace globals
+///
+/// @brief Writes the whole of `data` to `os`.
+///
+void write_all(std::ostream &os, const std::vector<std::byte> &data)
+{
+    stats::Timer t(stats::write);
+    os.write(reinterpret_cast<const char *> (data.data()), data.size());
+}
 
 ///
 /// @brief Compresses the contents of `is` and writes the result to `os`.
@@ -53,123 +83,352 @@ const CodeType dms {std::numeric_limits<CodeType>::max()};
 ///
 void compress(std::istream &is, std::ostream &os)
 {
-    std::map<std::pair<CodeType, char>, CodeType> dictionary;
+    std::vector<std::byte> out;
 
-    // "named" lambda function, used to reset the dictionary to its initial contents
-    const auto reset_dictionary = [&dictionary] {
-        dictionary.clear();
+    lzw::compress(read_all(is), out);
+    write_all(os, out);
+}
 
-        const long int minc = std::numeric_limits<char>::min();
-        const long int maxc = std::numeric_limits<char>::max();
+///
+/// @brief Decompresses the contents of `is` and writes the result to `os`.
+/// @param [in] is      input stream
+/// @param [out] os     output stream
+///
+void decompress(std::istream &is, std::ostream &os)
+{
+    std::vector<std::byte> out;
 
-        for (long int c = minc; c <= maxc; ++c)
-        {
-            // to prevent Undefined Behavior, resulting from reading and modifying
-            // the dictionary object at the same time
-            const CodeType dictionary_size = dictionary.size();
+    lzw::decompress(read_all(is), out);
+    write_all(os, out);
+}
 
-            dictionary[{globals::dms, static_cast<char> (c)}] = dictionary_size;
-        }
-    };
+///
+/// @brief Compresses the contents of `is` into `os` in the variable-width format.
+/// @param [in] is          input stream
+/// @param [out] os         output stream
+/// @param max_width        width of the codes when the dictionary is full
+///
+void compress_variable(std::istream &is, std::ostream &os, unsigned max_width)
+{
+    std::vector<std::byte> out;
 
-    reset_dictionary();
+    lzw::compress_variable(read_all(is), out, max_width);
+    write_all(os, out);
+}
 
-    CodeType i {globals::dms}; // Index
-    char c;
+///
+/// @brief Decompresses the contents of `is`, written by `compress_variable()`, into `os`.
+/// @param [in] is      input stream
+/// @param [out] os     output stream
+///
+void decompress_variable(std::istream &is, std::ostream &os)
+{
+    std::vector<std::byte> out;
 
-    while (is.get(c))
-    {
-        // dictionary's maximum size was reached
-        if (dictionary.size() == globals::dms)
-            reset_dictionary();
+    lzw::decompress_variable(read_all(is), out);
+    write_all(os, out);
+}
 
-        if (dictionary.count({i, c}) == 0)
-        {
-            // to prevent Undefined Behavior, resulting from reading and modifying
-            // the dictionary object at the same time
-            const CodeType dictionary_size = dictionary.size();
+///
+/// @brief Reads and checks the trained dictionary in the file `name`.
+///
+dictionary::Dictionary load_dictionary(const char *name)
+{
+    std::ifstream file(name, std::ios_base::binary);
 
-            dictionary[{i, c}] = dictionary_size;
-            os.write(reinterpret_cast<const char *> (&i), sizeof (CodeType));
-            i = dictionary.at({globals::dms, c});
-        }
-        else
-            i = dictionary.at({i, c});
-    }
+    if (!file.is_open())
+        throw std::runtime_error(std::string("dictionary `") + name + "' could not be opened");
 
-    if (i != globals::dms)
-        os.write(reinterpret_cast<const char *> (&i), sizeof (CodeType));
+    return dictionary::load(read_all(file));
 }
 
 ///
-/// @brief Decompresses the contents of `is` and writes the result to `os`.
+/// @brief Compresses the contents of `is` into `os` as a primed message.
+/// @param [in] is          input stream
+/// @param [out] os         output stream
+/// @param d                trained dictionary
+/// @param max_width        width of the codes when the dictionary is full
+///
+void compress_primed(std::istream &is, std::ostream &os, const dictionary::Dictionary &d, unsigned max_width)
+{
+    std::vector<std::byte> out;
+
+    lzw::PrimedCompressor(d, max_width).compress(read_all(is), out);
+    write_all(os, out);
+}
+
+///
+/// @brief Decompresses the contents of `is`, written by `compress_primed()`, into `os`.
 /// @param [in] is      input stream
 /// @param [out] os     output stream
+/// @param d            trained dictionary the message was compressed with
 ///
-void decompress(std::istream &is, std::ostream &os)
+void decompress_primed(std::istream &is, std::ostream &os, const dictionary::Dictionary &d)
 {
-    std::vector<std::pair<CodeType, char>> dictionary;
+    const std::vector<std::byte> in {read_all(is)};
+    std::vector<std::byte> out;
 
-    // "named" lambda function, used to reset the dictionary to its initial contents
-    const auto reset_dictionary = [&dictionary] {
-        dictionary.clear();
-        dictionary.reserve(globals::dms);
+    if (!lzw::has_header(in, lzw::globals::primed_header_size, lzw::globals::primed_version))
+        throw std::runtime_error("not a primed LZW message");
 
-        const long int minc = std::numeric_limits<char>::min();
-        const long int maxc = std::numeric_limits<char>::max();
+    lzw::PrimedDecompressor(d, lzw::header_width(in)).decompress(in, out);
+    write_all(os, out);
+}
 
-        for (long int c = minc; c <= maxc; ++c)
-            dictionary.push_back({globals::dms, static_cast<char> (c)});
-    };
+///
+/// @brief Compresses the contents of `is` into `os` in the hybrid LZW + Huffman format.
+/// @param [in] is          input stream
+/// @param [out] os         output stream
+/// @param max_width        width of the codes when the dictionary is full
+///
+void compress_hybrid(std::istream &is, std::ostream &os, unsigned max_width)
+{
+    std::vector<std::byte> out;
 
-    const auto rebuild_string = [&dictionary](CodeType k) -> std::vector<char> {
-        std::vector<char> s; // String
+    lzw::compress_hybrid(read_all(is), out, max_width);
+    write_all(os, out);
+}
 
-        while (k != globals::dms)
-        {
-            s.push_back(dictionary.at(k).second);
-            k = dictionary.at(k).first;
-        }
+///
+/// @brief Decompresses the contents of `is`, written by `compress_hybrid()`, into `os`.
+/// @param [in] is      input stream
+/// @param [out] os     output stream
+///
+void decompress_hybrid(std::istream &is, std::ostream &os)
+{
+    std::vector<std::byte> out;
 
-        std::reverse(s.begin(), s.end());
-        return s;
-    };
+    lzw::decompress_hybrid(read_all(is), out);
+    write_all(os, out);
+}
+
+///
+/// @brief Reads exactly `data.size()` bytes of `is`, starting at `position`.
+///
+void read_at(std::istream &is, std::streamoff position, std::vector<std::byte> &data)
+{
+    is.seekg(position);
+    is.read(reinterpret_cast<char *> (data.data()), data.size());
+
+    if (static_cast<std::size_t> (is.gcount()) != data.size())
+        throw std::runtime_error("truncated compressed file");
+}
 
-    reset_dictionary();
+///
+/// @brief Compresses the contents of `is` into `os` as independent chunks, on `workers` threads.
+/// @param [in] is          input stream
+/// @param [out] os         output stream
+/// @param max_width        width of the codes when a dictionary is full
+/// @param workers          number of threads
+///
+/// The chunks are read, compressed and written by the stages of `pipeline::run()`,
+/// so only a few of them are in memory at a time and reading and writing
+/// overlap with compression.
+///
+void compress_parallel(std::istream &is, std::ostream &os, unsigned max_width, unsigned workers)
+{
+    std::byte header[lzw::globals::parallel_header_size];
+    std::vector<std::byte> table;
+    std::uint64_t original {0};
+    std::uint64_t compressed {sizeof header};
+    std::vector<lzw::Compressor> coders;
+
+    // each worker keeps its dictionary from one chunk to the next
+    for (unsigned w = 0; w < workers; ++w)
+        coders.emplace_back(max_width);
+
+    lzw::put_parallel_header(header, max_width);
+    os.write(reinterpret_cast<const char *> (header), sizeof header);
+
+    pipeline::run(workers, 2 * workers,
+        [&](pipeline::Block &in) {
+            stats::Timer t(stats::read);
+
+            in.data.resize(lzw::globals::chunk_size);
+            is.read(reinterpret_cast<char *> (in.data.data()), in.data.size());
+            in.size = is.gcount();
+            return in.size != 0;
+        },
+        [&](unsigned w, pipeline::Block &in, pipeline::Block &out) {
+            coders[w].pack_chunk(std::span(in.data.data(), in.size), out.data);
+            out.size = out.data.size();
+        },
+        [&](pipeline::Block &out) {
+            stats::Timer t(stats::write);
+            std::byte entry[lzw::globals::table_entry_size];
+
+            lzw::put_u32(entry, static_cast<std::uint32_t> (out.size));
+            // a chunk is only coded if that makes it smaller, so one of the same size is stored
+            lzw::put_u32(entry + 4, static_cast<std::uint32_t> (out.input_size)
+                | (out.size == out.input_size ? lzw::globals::stored_chunk : 0));
+            table.insert(table.end(), entry, entry + sizeof entry);
+            os.write(reinterpret_cast<const char *> (out.data.data()), out.size);
+            original += out.input_size;
+            compressed += out.size;
+        });
+
+    table.resize(table.size() + 4);
+    lzw::put_u32(&table[table.size() - 4], static_cast<std::uint32_t> (table.size() / lzw::globals::table_entry_size));
+    write_all(os, table);
+    stats::add(stats::bytes_in, original);
+    stats::add(stats::bytes_out, compressed + table.size());
+}
 
-    CodeType i {globals::dms}; // Index
-    CodeType k; // Key
+///
+/// @brief Decompresses the contents of `is`, written by `compress_parallel()`, into `os`.
+/// @param [in] is          input stream
+/// @param [out] os         output stream
+/// @param workers          number of threads
+///
+/// The table at the end of the file says where every chunk is, so the chunks
+/// can go through the stages of `pipeline::run()` one by one. An input that
+/// cannot seek, such as a pipe, is read whole instead.
+///
+void decompress_parallel(std::istream &is, std::ostream &os, unsigned workers)
+{
+    const std::streamoff file_size {is.seekg(0, std::ios_base::end).tellg()};
 
-    while (is.read(reinterpret_cast<char *> (&k), sizeof (CodeType)))
+    if (file_size < 0)
     {
-        // dictionary's maximum size was reached
-        if (dictionary.size() == globals::dms)
-            reset_dictionary();
+        std::vector<std::byte> out;
 
-        if (k > dictionary.size())
-            throw std::runtime_error("invalid compressed code");
+        is.clear();
+        lzw::decompress_parallel(read_all(is), out, workers);
+        write_all(os, out);
+        return;
+    }
 
-        std::vector<char> s; // String
+    std::vector<std::byte> header(lzw::globals::parallel_header_size);
+    std::vector<std::byte> end(4);
+    std::vector<std::byte> table;
 
-        if (k == dictionary.size())
-        {
-            dictionary.push_back({i, rebuild_string(i).front()});
-            s = rebuild_string(k);
-        }
-        else
-        {
-            s = rebuild_string(k);
+    {
+        stats::Timer t(stats::read);
 
-            if (i != globals::dms)
-                dictionary.push_back({i, s.front()});
-        }
+        if (static_cast<std::size_t> (file_size) < lzw::globals::parallel_header_size + 4)
+            throw std::runtime_error("not a parallel LZW file");
+
+        read_at(is, 0, header);
+
+        if (!lzw::has_header(header, header.size(), lzw::globals::parallel_version))
+            throw std::runtime_error("not a parallel LZW file");
+
+        read_at(is, file_size - 4, end);
+        table.resize(lzw::chunk_table_size(end.data(), file_size));
+        read_at(is, file_size - table.size(), table);
+        is.seekg(lzw::globals::parallel_header_size);
+    }
+
+    const unsigned max_width {lzw::header_width(header)};
+    const lzw::ChunkTable chunks {lzw::read_chunk_table(header, table, file_size)};
+    const std::size_t count {chunks.starts.size() - 1};
+    std::size_t next {0};
+    std::vector<lzw::Decompressor> coders;
+
+    for (unsigned w = 0; w < workers; ++w)
+        coders.emplace_back(max_width);
+
+    // the chunks follow each other, so the reader never has to seek
+    pipeline::run(workers, 2 * workers,
+        [&](pipeline::Block &in) {
+            if (next == count)
+                return false;
+
+            stats::Timer t(stats::read);
+
+            in.size = chunks.offsets[next + 1] - chunks.offsets[next];
+            in.data.resize(in.size);
+            is.read(reinterpret_cast<char *> (in.data.data()), in.size);
+            ++next;
+
+            if (static_cast<std::size_t> (is.gcount()) != in.size)
+                throw std::runtime_error("truncated compressed file");
+
+            return true;
+        },
+        [&](unsigned w, pipeline::Block &in, pipeline::Block &out) {
+            out.size = chunks.starts[in.index + 1] - chunks.starts[in.index];
+            out.data.resize(out.size);
+            coders[w].decompress_chunk(std::span(in.data.data(), in.size), std::span(out.data.data(), out.size),
+                chunks.stored[in.index]);
+        },
+        [&](pipeline::Block &out) {
+            stats::Timer t(stats::write);
+
+            os.write(reinterpret_cast<const char *> (out.data.data()), out.size);
+        });
+
+    stats::add(stats::bytes_in, file_size);
+    stats::add(stats::bytes_out, chunks.starts[count]);
+}
+
+///
+/// @brief Reads what `is` has ready into `data`, waiting only if it has nothing at all.
+/// @returns false at the end of the input
+///
+/// A file stream refills its buffer with a single read, which on a pipe or a
+/// terminal returns what has been written so far instead of waiting for more.
+///
+bool read_ready(std::istream &is, std::vector<std::byte> &data)
+{
+    stats::Timer t(stats::read);
+
+    if (is.rdbuf()->sgetc() == std::char_traits<char>::eof())
+        return false;
+
+    data.resize(is.rdbuf()->in_avail());
+    is.read(reinterpret_cast<char *> (data.data()), data.size());
+    return true;
+}
+
+///
+/// @brief Compresses `is` into `os` in the stream format as the input arrives.
+/// @param [in] is          input stream, usually a pipe
+/// @param [out] os         output stream
+/// @param max_width        width of the codes when the dictionary is full
+///
+/// Whenever it has compressed everything the input had ready, it writes a
+/// flush point and flushes `os`, so a decoder reading the other end is never
+/// behind by more than what the producer is still writing. A producer that
+/// writes a whole message at a time gets a flush point after every message.
+///
+void compress_stream(std::istream &is, std::ostream &os, unsigned max_width)
+{
+    lzw::StreamCompressor coder(max_width);
+    std::vector<std::byte> in;
+    std::vector<std::byte> out;
 
-        os.write(&s.front(), s.size());
-        i = k;
+    // the first pass has no input yet and writes just the header, which lets
+    // the decoder check it before any data arrives
+    do
+    {
+        out.clear();
+        coder.compress(in, out);
+        coder.flush(out);
+        write_all(os, out);
+        os.flush();
     }
+    while (read_ready(is, in));
+}
+
+///
+/// @brief Decompresses `is`, written by `compress_stream()`, into `os` as the input arrives.
+/// @param [in] is      input stream, usually a pipe
+/// @param [out] os     output stream
+///
+void decompress_stream(std::istream &is, std::ostream &os)
+{
+    lzw::StreamDecompressor coder;
+    std::vector<std::byte> in;
+    std::vector<std::byte> out;
 
-    if (!is.eof() || is.gcount() != 0)
-        throw std::runtime_error("corrupted compressed file");
+    while (read_ready(is, in))
+    {
+        out.clear();
+        coder.decompress(in, out);
+        write_all(os, out);
+        os.flush();
+    }
 }
 
 ///
@@ -185,12 +444,33 @@ void print_usage(const std::string &s = "", bool su = true)
     if (su)
     {
         std::cerr << "\nUsage:\n";
-        std::cerr << "\tprogram -flag input_file output_file\n\n";
+        std::cerr << "\tprogram -flag [-b bits] [-j threads] [-D dictionary] [--stats] input_file output_file\n\n";
         std::cerr << "Where `flag' is either `c' for compressing, or `d' for decompressing, and\n";
-        std::cerr << "`input_file' and `output_file' are distinct files.\n\n";
+        std::cerr << "`input_file' and `output_file' are distinct files.\n";
+        std::cerr << "The flags `cv' and `dv' use the variable-width format instead, whose codes\n";
+        std::cerr << "grow up to `bits' bits (" << lzw::globals::min_width << " to " << lzw::globals::max_width;
+        std::cerr << ", " << lzw::globals::default_width << " by default).\n";
+        std::cerr << "The flags `cp' and `dp' split the variable-width codes into independent chunks,\n";
+        std::cerr << "which are processed on `threads' threads (" << parallel::default_workers() << " by default).\n";
+        std::cerr << "The flags `ch' and `dh' also Huffman-code the variable-width codes, which is\n";
+        std::cerr << "smaller but somewhat slower.\n";
+        std::cerr << "The flags `cs' and `ds' use the stream format, for live data such as a pipe:\n";
+        std::cerr << "whatever has arrived is compressed and flushed at once, keeping the dictionary,\n";
+        std::cerr << "and the decompressor writes it out as soon as it reads it.\n";
+        std::cerr << "With `cv' and `dv', the option `-D' primes the LZW dictionary with the sample of\n";
+        std::cerr << "the trained `dictionary', which shrinks small files; only the same dictionary\n";
+        std::cerr << "is needed to decompress, as `bits' is stored in the header.\n";
+        std::cerr << "The option `--stats' prints the time of every phase and some counters, if the\n";
+        std::cerr << "program was compiled with -DCODEC_STATS.\n\n";
         std::cerr << "Examples:\n";
         std::cerr << "\tlzw_v3.exe -c license.txt license.lzw\n";
         std::cerr << "\tlzw_v3.exe -d license.lzw new_license.txt\n";
+        std::cerr << "\tlzw_v3.exe -cv -b 12 license.txt license.lzw\n";
+        std::cerr << "\tlzw_v3.exe -dv license.lzw new_license.txt\n";
+        std::cerr << "\tlzw_v3.exe -cp -j 8 big.tar big.lzw\n";
+        std::cerr << "\tlzw_v3.exe -ch license.txt license.lzw\n";
+        std::cerr << "\tlzw_v3.exe -cv -D messages.dic message.json message.lzw\n";
+        std::cerr << "\ttail -f app.log | lzw_v3.exe -cs /dev/stdin /dev/stdout | lzw_v3.exe -ds /dev/stdin app.copy\n";
     }
 
     std::cerr << std::endl;
@@ -205,7 +485,7 @@ void print_usage(const std::string &s = "", bool su = true)
 ///
 int main(int argc, char *argv[])
 {
-    if (argc != 4)
+    if (argc < 4)
     {
         print_usage("Wrong number of arguments.");
         return EXIT_FAILURE;
@@ -213,7 +493,15 @@ int main(int argc, char *argv[])
 
     enum class Mode {
         Compress,
-        Decompress
+        Decompress,
+        CompressVariable,
+        DecompressVariable,
+        CompressParallel,
+        DecompressParallel,
+        CompressHybrid,
+        DecompressHybrid,
+        CompressStream,
+        DecompressStream
     };
 
     Mode m;
@@ -224,11 +512,82 @@ int main(int argc, char *argv[])
     if (std::string(argv[1]) == "-d")
         m = Mode::Decompress;
     else
+    if (std::string(argv[1]) == "-cv")
+        m = Mode::CompressVariable;
+    else
+    if (std::string(argv[1]) == "-dv")
+        m = Mode::DecompressVariable;
+    else
+    if (std::string(argv[1]) == "-cp")
+        m = Mode::CompressParallel;
+    else
+    if (std::string(argv[1]) == "-dp")
+        m = Mode::DecompressParallel;
+    else
+    if (std::string(argv[1]) == "-ch")
+        m = Mode::CompressHybrid;
+    else
+    if (std::string(argv[1]) == "-dh")
+        m = Mode::DecompressHybrid;
+    else
+    if (std::string(argv[1]) == "-cs")
+        m = Mode::CompressStream;
+    else
+    if (std::string(argv[1]) == "-ds")
+        m = Mode::DecompressStream;
+    else
     {
         print_usage(std::string("flag `") + argv[1] + "' is not recognized.");
         return EXIT_FAILURE;
     }
 
+    unsigned max_width {lzw::globals::default_width};
+    unsigned workers {parallel::default_workers()};
+    bool print_stats {false};
+    const char *dictionary_name {nullptr};
+
+    for (int a = 2; a < argc - 2; a += 2)
+    {
+        const std::string option {argv[a]};
+
+        if (option == "--stats")
+        {
+            print_stats = true;
+            --a;
+            continue;
+        }
+
+        if (a + 1 >= argc - 2)
+        {
+            print_usage("Wrong number of arguments.");
+            return EXIT_FAILURE;
+        }
+
+        if (option == "-D" && (m == Mode::CompressVariable || m == Mode::DecompressVariable))
+        {
+            dictionary_name = argv[a + 1];
+            continue;
+        }
+
+        const int value {std::atoi(argv[a + 1])};
+
+        if (option == "-b" && (m == Mode::CompressVariable || m == Mode::CompressParallel || m == Mode::CompressHybrid
+            || m == Mode::CompressStream)
+        && value >= static_cast<int> (lzw::globals::min_width) && value <= static_cast<int> (lzw::globals::max_width))
+            max_width = value;
+        else
+        if (option == "-j" && (m == Mode::CompressParallel || m == Mode::DecompressParallel) && value >= 1)
+            workers = value;
+        else
+        {
+            print_usage(std::string("`") + argv[a] + ' ' + argv[a + 1] + "' is not valid here.");
+            return EXIT_FAILURE;
+        }
+    }
+
+    const char *input_name {argv[argc - 2]};
+    const char *output_name {argv[argc - 1]};
+
     const std::size_t buffer_size {1024 * 1024};
 
     // these custom buffers should be larger than the default ones
@@ -239,20 +598,20 @@ int main(int argc, char *argv[])
     std::ofstream output_file;
 
     input_file.rdbuf()->pubsetbuf(input_buffer.get(), buffer_size);
-    input_file.open(argv[2], std::ios_base::binary);
+    input_file.open(input_name, std::ios_base::binary);
 
     if (!input_file.is_open())
     {
-        print_usage(std::string("input_file `") + argv[2] + "' could not be opened.");
+        print_usage(std::string("input_file `") + input_name + "' could not be opened.");
         return EXIT_FAILURE;
     }
 
     output_file.rdbuf()->pubsetbuf(output_buffer.get(), buffer_size);
-    output_file.open(argv[3], std::ios_base::binary);
+    output_file.open(output_name, std::ios_base::binary);
 
     if (!output_file.is_open())
     {
-        print_usage(std::string("output_file `") + argv[3] + "' could not be opened.");
+        print_usage(std::string("output_file `") + output_name + "' could not be opened.");
         return EXIT_FAILURE;
     }
 
@@ -261,22 +620,45 @@ int main(int argc, char *argv[])
         input_file.exceptions(std::ios_base::badbit);
         output_file.exceptions(std::ios_base::badbit | std::ios_base::failbit);
 
-        if (m == Mode::Compress){
-            double tTime = 0;
-            auto start = std::chrono::high_resolution_clock::now();
+        if (m == Mode::Compress)
             compress(input_file, output_file);
-            auto finish = std::chrono::high_resolution_clock::now();
-            auto time = std::chrono::duration_cast<std::chrono::milliseconds>(finish - start);
-            std::cout<<time.count();
-        }
         else
-        if (m == Mode::Decompress){
-            auto start = std::chrono::high_resolution_clock::now();
+        if (m == Mode::Decompress)
             decompress(input_file, output_file);
-            auto finish = std::chrono::high_resolution_clock::now();
-            auto time = std::chrono::duration_cast<std::chrono::milliseconds>(finish - start);
-            std::cout<<time.count();
+        else
+        if (m == Mode::CompressVariable)
+        {
+            if (dictionary_name != nullptr)
+                compress_primed(input_file, output_file, load_dictionary(dictionary_name), max_width);
+            else
+                compress_variable(input_file, output_file, max_width);
         }
+        else
+        if (m == Mode::DecompressVariable)
+        {
+            if (dictionary_name != nullptr)
+                decompress_primed(input_file, output_file, load_dictionary(dictionary_name));
+            else
+                decompress_variable(input_file, output_file);
+        }
+        else
+        if (m == Mode::CompressParallel)
+            compress_parallel(input_file, output_file, max_width, workers);
+        else
+        if (m == Mode::DecompressParallel)
+            decompress_parallel(input_file, output_file, workers);
+        else
+        if (m == Mode::CompressHybrid)
+            compress_hybrid(input_file, output_file, max_width);
+        else
+        if (m == Mode::DecompressHybrid)
+            decompress_hybrid(input_file, output_file);
+        else
+        if (m == Mode::CompressStream)
+            compress_stream(input_file, output_file, max_width);
+        else
+        if (m == Mode::DecompressStream)
+            decompress_stream(input_file, output_file);
     }
     catch (const std::ios_base::failure &f)
     {
@@ -289,5 +671,13 @@ int main(int argc, char *argv[])
         return EXIT_FAILURE;
     }
 
+    if (print_stats)
+    {
+        if (stats::enabled)
+            stats::print(stderr, stats::collect());
+        else
+            print_usage("--stats needs a build with -DCODEC_STATS.", false);
+    }
+
     return EXIT_SUCCESS;
 }
@@ -1,8 +1,11 @@
 #!/bin/bash
 
-for i in {1..3}
-do
-    echo "Ejecución $i:" >> salida.txt
-    ./a.out -c english.part_5MB $i >> salida.txt
-    echo "" >> salida.txt
-done
+# Mide los códecs LZW con english.part_5MB usando bench/benchmark, que
+# comprueba además la ida y vuelta. Se lanza desde lzw/; el informe JSON
+# queda en salida.json y el script termina con error si algo falla.
+
+cd "$(dirname "$0")" || exit 1
+
+../bench/benchmark -n 3 -s 0 \
+    -c lzw -c lzw-variable -c lzw-primed -c lzw-parallel -c lzw-hybrid -c lzw-stream -c lzw-stream-chunked \
+    -o salida.json english.part_5MB "$@"
@@ -0,0 +1,115 @@
+///
+/// @file
+/// @brief Trains a dictionary for compressing small messages.
+///
+/// Reads a set of typical messages, trains a dictionary on their concatenation
+/// (see `common/dictionary.hpp`) and saves it to a file, which the MCompres
+/// tools take with `-d` and `lzw_v3` with `-D`. The more representative the
+/// sample files, the better the dictionary; a few megabytes are plenty.
+///
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <span>
+#include <string>
+#include <vector>
+#include "../common/dictionary.hpp"
+
+///
+/// @brief Appends the contents of the file `name` to `data`.
+/// @returns false if the file could not be read
+///
+bool append_file(const char *name, std::vector<std::byte> &data)
+{
+    std::ifstream file(name, std::ios_base::binary);
+
+    if (!file.is_open())
+        return false;
+
+    file.seekg(0, std::ios_base::end);
+    const std::streamoff size {file.tellg()};
+    file.seekg(0);
+
+    if (size < 0)
+        return false;
+
+    data.resize(data.size() + size);
+    file.read(reinterpret_cast<char *> (data.data() + data.size() - size), size);
+    return file.gcount() == size;
+}
+
+///
+/// @brief Prints the usage of the program to `std::cerr`.
+///
+void print_usage(const char *program)
+{
+    std::cerr << "Usage:\n\t" << program << " [-s sample_bytes] [-i id] output_file sample_file...\n\n";
+    std::cerr << "Trains a dictionary on the sample files and writes it to `output_file'.\n";
+    std::cerr << "  -s sample_bytes   size of the LZW sample (" << dictionary::default_sample_size << " by default)\n";
+    std::cerr << "  -i id             ID of the dictionary, other than 0 (derived from its contents by default)\n";
+}
+
+int main(int argc, char *argv[])
+{
+    std::size_t sample_size {dictionary::default_sample_size};
+    std::uint32_t id {0};
+    int a {1};
+
+    for (; a + 1 < argc && argv[a][0] == '-'; a += 2)
+    {
+        const std::string option {argv[a]};
+
+        if (option == "-s" && std::atol(argv[a + 1]) > 0)
+            sample_size = std::atol(argv[a + 1]);
+        else
+        if (option == "-i" && std::strtoul(argv[a + 1], nullptr, 0) != 0)
+            id = static_cast<std::uint32_t> (std::strtoul(argv[a + 1], nullptr, 0));
+        else
+            break;
+    }
+
+    if (argc - a < 2)
+    {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<std::byte> corpus;
+
+    for (int i = a + 1; i < argc; ++i)
+        if (!append_file(argv[i], corpus))
+        {
+            std::cerr << "Could not read `" << argv[i] << "'.\n";
+            return EXIT_FAILURE;
+        }
+
+    try
+    {
+        const dictionary::Dictionary d {dictionary::train(corpus, sample_size, id)};
+        const std::vector<std::byte> data {dictionary::save(d)};
+        std::ofstream output(argv[a], std::ios_base::binary);
+
+        output.write(reinterpret_cast<const char *> (data.data()), data.size());
+
+        if (!output)
+        {
+            std::cerr << "Could not write `" << argv[a] << "'.\n";
+            return EXIT_FAILURE;
+        }
+
+        std::printf("dictionary %08x: %zu bytes of sample from %zu bytes of messages\n",
+            static_cast<unsigned> (d.id), d.sample.size(), corpus.size());
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Caught exception: " << e.what() << ".\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}